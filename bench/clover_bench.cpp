@@ -0,0 +1,445 @@
+/*
+Clover benchmarks - measures the cost of CommandLineOptions' hot paths.
+
+Synthetic schemas (10 to 10,000 options of mixed types and name lengths) are
+combined with synthetic command lines (1 to 1,000,000 arguments) and the
+following are reported for Parse(), WasFound() and PrintUsage():
+
+    ns/unit     wall time per argument for Parse(), per query for WasFound(),
+                and per option for AddOption() and PrintUsage(),
+    allocs      global operator new calls per call,
+    misses      hardware cache misses per call, via perf_event_open() when
+                available (Linux, with perf_event_paranoid permitting).
+
+Parse() is also compared against getopt_long() over the same schema and
+command line, where getopt_long() is available.
+
+BUILDING
+========
+
+There is no build script; compile this file on its own (it defines
+CLOVER_IMPLEMENTATION itself):
+
+    c++ -O2 -std=c++17 -I.. clover_bench.cpp -o clover_bench
+
+Run "clover_bench --help" for options.  Combinations whose options x arguments
+product exceeds --max-work are skipped to bound the run time.
+*/
+#define CLOVER_IMPLEMENTATION
+#include "clover.h"
+
+#include <algorithm>
+#include <chrono>
+#include <memory>
+#include <new>
+#include <random>
+#include <string>
+#include <vector>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__unix__) || defined(__APPLE__)
+#define CLOVER_BENCH_HAS_GETOPT 1
+#include <getopt.h>
+#endif
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+// -----------------------------------------------------------------------------
+// Allocation counting
+
+static uint64_t gAllocationCount = 0;
+
+void* operator new(size_t size)
+{
+    ++gAllocationCount;
+    if (void* p = malloc(size == 0 ? 1 : size)) {
+        return p;
+    }
+    throw std::bad_alloc();
+}
+
+void operator delete(void* p) noexcept
+{
+    free(p);
+}
+
+void operator delete(void* p, size_t) noexcept
+{
+    free(p);
+}
+
+// -----------------------------------------------------------------------------
+// Cache miss counting
+
+struct CacheMissCounter {
+    int fd_ = -1;
+
+    CacheMissCounter()
+    {
+        #ifdef __linux__
+        perf_event_attr pe;
+        memset(&pe, 0, sizeof(pe));
+        pe.type           = PERF_TYPE_HARDWARE;
+        pe.size           = sizeof(pe);
+        pe.config         = PERF_COUNT_HW_CACHE_MISSES;
+        pe.disabled       = 1;
+        pe.exclude_kernel = 1;
+        pe.exclude_hv     = 1;
+        fd_ = (int) syscall(__NR_perf_event_open, &pe, 0, -1, -1, 0);
+        #endif
+    }
+
+    ~CacheMissCounter()
+    {
+        #ifdef __linux__
+        if (fd_ != -1) {
+            close(fd_);
+        }
+        #endif
+    }
+
+    bool IsAvailable() const { return fd_ != -1; }
+
+    void Start()
+    {
+        #ifdef __linux__
+        if (fd_ != -1) {
+            ioctl(fd_, PERF_EVENT_IOC_RESET, 0);
+            ioctl(fd_, PERF_EVENT_IOC_ENABLE, 0);
+        }
+        #endif
+    }
+
+    uint64_t Stop()
+    {
+        uint64_t count = 0;
+        #ifdef __linux__
+        if (fd_ != -1) {
+            ioctl(fd_, PERF_EVENT_IOC_DISABLE, 0);
+            if (read(fd_, &count, sizeof(count)) != sizeof(count)) {
+                count = 0;
+            }
+        }
+        #endif
+        return count;
+    }
+};
+
+// -----------------------------------------------------------------------------
+// Synthetic schemas and command lines
+
+struct Schema {
+    enum Type { BOOL, UINT32, STRING };
+
+    std::vector<std::string> names_;
+    std::vector<Type> types_;
+
+    // Storage for the parsed values.
+    std::unique_ptr<bool[]> bools_;
+    std::unique_ptr<uint32_t[]> uints_;
+    std::unique_ptr<char*[]> strings_;
+
+    Schema(uint32_t optionCount, std::mt19937& rng)
+        : bools_(new bool[optionCount])
+        , uints_(new uint32_t[optionCount])
+        , strings_(new char*[optionCount])
+    {
+        std::uniform_int_distribution<int> lengthDist(3, 32);
+        std::uniform_int_distribution<int> letterDist('a', 'z');
+        std::uniform_int_distribution<int> typeDist(BOOL, STRING);
+        for (uint32_t i = 0; i < optionCount; ++i) {
+            // Suffix the index so names are unique.
+            auto suffix = "-" + std::to_string(i);
+            auto length = std::max(lengthDist(rng) - (int) suffix.size(), 1);
+            std::string name;
+            for (int j = 0; j < length; ++j) {
+                name += (char) letterDist(rng);
+            }
+            names_.emplace_back(name + suffix);
+            types_.emplace_back((Type) typeDist(rng));
+        }
+    }
+
+    void Register(CommandLineOptionsT<char>* opts)
+    {
+        for (size_t i = 0; i < names_.size(); ++i) {
+            auto name = names_[i].c_str();
+            switch (types_[i]) {
+            case BOOL:   opts->AddOption(&bools_[i],   name,        "Synthetic bool option."); break;
+            case UINT32: opts->AddOption(&uints_[i],   name, "N",   "Synthetic uint32 option."); break;
+            case STRING: opts->AddOption(&strings_[i], name, "STR", "Synthetic string option."); break;
+            }
+        }
+    }
+
+    std::string MakeArgument(size_t i) const
+    {
+        switch (types_[i]) {
+        case BOOL:   return "--" + names_[i];
+        case UINT32: return "--" + names_[i] + "=" + std::to_string(i);
+        default:     return "--" + names_[i] + "=value" + std::to_string(i);
+        }
+    }
+};
+
+struct CommandLine {
+    std::vector<std::string> storage_;
+    std::vector<char*> argv_;
+
+    CommandLine(Schema const& schema, uint32_t argCount, std::mt19937& rng)
+    {
+        std::uniform_int_distribution<size_t> optionDist(0, schema.names_.size() - 1);
+        storage_.reserve(argCount + 1);
+        storage_.emplace_back("clover_bench");
+        for (uint32_t i = 0; i < argCount; ++i) {
+            storage_.emplace_back(schema.MakeArgument(optionDist(rng)));
+        }
+        for (auto& s : storage_) {
+            argv_.emplace_back(&s[0]);
+        }
+        argv_.emplace_back(nullptr);
+    }
+
+    int argc() const { return (int) storage_.size(); }
+};
+
+// -----------------------------------------------------------------------------
+// Measurement
+
+struct Measurement {
+    double nsPerUnit_;
+    double allocsPerCall_;
+    double missesPerCall_;
+};
+
+// Runs fn() repeatedly for at least minSeconds (and at least minIterations
+// times) and returns the cost per call divided by unitsPerCall.
+template<typename Fn>
+static Measurement Measure(CacheMissCounter* counter, uint64_t unitsPerCall, uint32_t minIterations, double minSeconds, Fn fn)
+{
+    using Clock = std::chrono::steady_clock;
+
+    uint64_t iterations = 0;
+    uint64_t allocations = 0;
+    uint64_t misses = 0;
+    double seconds = 0.0;
+    while (iterations < minIterations || seconds < minSeconds) {
+        auto allocationsBefore = gAllocationCount;
+        counter->Start();
+        auto t0 = Clock::now();
+        fn();
+        auto t1 = Clock::now();
+        misses += counter->Stop();
+        allocations += gAllocationCount - allocationsBefore;
+        seconds += std::chrono::duration<double>(t1 - t0).count();
+        iterations += 1;
+    }
+
+    Measurement m;
+    m.nsPerUnit_     = seconds * 1e9 / (double) (iterations * std::max<uint64_t>(unitsPerCall, 1));
+    m.allocsPerCall_ = (double) allocations / (double) iterations;
+    m.missesPerCall_ = (double) misses / (double) iterations;
+    return m;
+}
+
+static void Report(CacheMissCounter const& counter, uint32_t optionCount, uint32_t argCount, char const* what, Measurement const& m)
+{
+    printf("%8u %9u  %-18s %12.1f %10.1f ", optionCount, argCount, what, m.nsPerUnit_, m.allocsPerCall_);
+    if (counter.IsAvailable()) {
+        printf("%12.1f\n", m.missesPerCall_);
+    } else {
+        printf("%12s\n", "n/a");
+    }
+    fflush(stdout);
+}
+
+#if CLOVER_BENCH_HAS_GETOPT
+static int ParseWithGetoptLong(Schema const& schema, std::vector<option> const& longOptions, CommandLine const& commandLine, std::vector<char*>* argvCopy)
+{
+    // getopt_long() permutes argv, so it works on a fresh copy each time.
+    *argvCopy = commandLine.argv_;
+
+    optind = 0;
+    opterr = 0;
+    int matched = 0;
+    int longIndex = 0;
+    while (getopt_long(commandLine.argc(), argvCopy->data(), "", longOptions.data(), &longIndex) != -1) {
+        matched += 1;
+        if (optarg != nullptr && schema.types_[longIndex] == Schema::UINT32) {
+            schema.uints_[longIndex] = (uint32_t) strtoul(optarg, nullptr, 0);
+        }
+    }
+    return matched;
+}
+#endif
+
+int main(int argc, char** argv)
+{
+    uint32_t optionCountArg = 0;
+    uint32_t argCountArg = 0;
+    uint32_t hitPercent = 50;
+    uint32_t minIterations = 3;
+    uint32_t minMilliseconds = 50;
+    uint32_t maxWorkMillions = 2000;
+    uint32_t seed = 1;
+    bool skipGetopt = false;
+
+    CommandLineOptionsT<char> opts;
+    opts.AddOption(&optionCountArg,  "options",        "N",       "Only benchmark schemas with N options (default: 10, 100, 1000 and 10000).");
+    opts.AddOption(&argCountArg,     "args",           "N",       "Only benchmark command lines with N arguments (default: 1, 100, 10000 and 1000000).");
+    opts.AddOption(&hitPercent,      "hit-rate",       "PERCENT", "Percentage of WasFound() queries that name a registered option (default: 50).");
+    opts.AddOption(&minIterations,   "min-iterations", "N",       "Minimum number of times to repeat each measurement (default: 3).");
+    opts.AddOption(&minMilliseconds, "min-time",       "MS",      "Minimum time to spend on each measurement (default: 50).");
+    opts.AddOption(&maxWorkMillions, "max-work",       "M",       "Skip combinations where options x arguments exceeds M million (default: 2000).");
+    opts.AddOption(&seed,            "seed",           "N",       "Random seed used to generate schemas and command lines (default: 1).");
+    opts.AddOption(&skipGetopt,      "no-getopt",                 "Don't compare Parse() against getopt_long().");
+
+    int errorArgIndex = 0;
+    switch (opts.Parse(argc, argv, &errorArgIndex)) {
+    case CommandLineOptions_Ok: break;
+    case CommandLineOptions_HelpRequested:
+        opts.PrintUsage();
+        return 0;
+    default:
+        fprintf(stderr, "error: invalid command line argument: %s.\n", argv[errorArgIndex]);
+        opts.PrintUsage();
+        return 1;
+    }
+
+    std::vector<uint32_t> optionCounts = { 10, 100, 1000, 10000 };
+    std::vector<uint32_t> argCounts    = { 1, 100, 10000, 1000000 };
+    if (optionCountArg != 0) {
+        optionCounts = { optionCountArg };
+    }
+    if (argCountArg != 0) {
+        argCounts = { argCountArg };
+    }
+    hitPercent = std::min(hitPercent, 100u);
+
+    FILE* nullFile = fopen(
+        #ifdef _WIN32
+        "NUL",
+        #else
+        "/dev/null",
+        #endif
+        "w");
+    if (nullFile == nullptr) {
+        fprintf(stderr, "error: failed to open the null device.\n");
+        return 1;
+    }
+
+    CacheMissCounter counter;
+    if (!counter.IsAvailable()) {
+        printf("note: perf_event_open() is not available; cache misses are not reported.\n");
+    }
+
+    auto minSeconds = minMilliseconds / 1000.0;
+    std::mt19937 rng(seed);
+
+    printf("%8s %9s  %-18s %12s %10s %12s\n", "options", "args", "operation", "ns/unit", "allocs", "misses");
+    for (auto optionCount : optionCounts) {
+        Schema schema(optionCount, rng);
+
+        // Registration, reported per option.
+        {
+            auto m = Measure(&counter, optionCount, minIterations, minSeconds, [&]() {
+                CommandLineOptionsT<char> o;
+                schema.Register(&o);
+            });
+            Report(counter, optionCount, 0, "AddOption", m);
+        }
+
+        CommandLineOptionsT<char> o;
+        schema.Register(&o);
+
+        // PrintUsage, reported per option line.
+        {
+            auto m = Measure(&counter, optionCount, minIterations, minSeconds, [&]() {
+                o.PrintUsage(nullFile);
+            });
+            Report(counter, optionCount, 0, "PrintUsage", m);
+        }
+
+        // WasFound, reported per query.
+        {
+            std::uniform_int_distribution<size_t> optionDist(0, optionCount - 1);
+            std::uniform_int_distribution<uint32_t> percentDist(0, 99);
+            std::vector<std::string> queries;
+            for (uint32_t i = 0; i < 1000; ++i) {
+                auto name = schema.names_[optionDist(rng)];
+                if (percentDist(rng) >= hitPercent) {
+                    name += "-miss";
+                }
+                queries.emplace_back(name);
+            }
+            volatile uint32_t foundCount = 0;
+            auto m = Measure(&counter, queries.size(), minIterations, minSeconds, [&]() {
+                uint32_t n = 0;
+                for (auto const& q : queries) {
+                    n += o.WasFound(q.c_str()) ? 1 : 0;
+                }
+                foundCount = n;
+            });
+            Report(counter, optionCount, (uint32_t) queries.size(), "WasFound", m);
+        }
+
+        #if CLOVER_BENCH_HAS_GETOPT
+        std::vector<option> longOptions;
+        for (size_t i = 0; i < schema.names_.size(); ++i) {
+            longOptions.emplace_back(option{ schema.names_[i].c_str(), schema.types_[i] == Schema::BOOL ? no_argument : required_argument, nullptr, 0 });
+        }
+        longOptions.emplace_back(option{ nullptr, 0, nullptr, 0 });
+        #endif
+
+        for (auto argCount : argCounts) {
+            if ((uint64_t) optionCount * argCount > (uint64_t) maxWorkMillions * 1000000) {
+                printf("%8u %9u  %-18s (skipped, see --max-work)\n", optionCount, argCount, "Parse");
+                continue;
+            }
+
+            CommandLine commandLine(schema, argCount, rng);
+
+            // Parse where every argument matches.
+            {
+                auto m = Measure(&counter, argCount, minIterations, minSeconds, [&]() {
+                    if (o.Parse(commandLine.argc(), commandLine.argv_.data(), nullptr) != CommandLineOptions_Ok) {
+                        fprintf(stderr, "error: unexpected Parse() failure.\n");
+                        exit(1);
+                    }
+                });
+                Report(counter, optionCount, argCount, "Parse", m);
+            }
+
+            // Parse where the last argument is unrecognised.
+            {
+                std::string miss = "--unrecognised-argument";
+                auto argvMiss = commandLine.argv_;
+                argvMiss[argvMiss.size() - 2] = &miss[0];
+                auto m = Measure(&counter, argCount, minIterations, minSeconds, [&]() {
+                    o.Parse(commandLine.argc(), argvMiss.data(), nullptr);
+                });
+                Report(counter, optionCount, argCount, "Parse (last miss)", m);
+            }
+
+            #if CLOVER_BENCH_HAS_GETOPT
+            if (!skipGetopt) {
+                std::vector<char*> argvCopy;
+                argvCopy.reserve(commandLine.argv_.size());
+                auto m = Measure(&counter, argCount, minIterations, minSeconds, [&]() {
+                    ParseWithGetoptLong(schema, longOptions, commandLine, &argvCopy);
+                });
+                Report(counter, optionCount, argCount, "getopt_long", m);
+            }
+            #endif
+        }
+    }
+
+    fclose(nullFile);
+    return 0;
+}
@@ -0,0 +1,244 @@
+/*
+Clover parse cache benchmark - finds where ParseCached() starts to beat Parse().
+
+A cache hit replaces matching and converting the arguments with hashing them,
+mapping a file and comparing the arguments with the ones it holds, so it only
+pays off for long enough command lines.  For command lines of 1 to 20,000
+arguments over one schema, this reports percentiles of:
+
+    parse           Parse(),
+    cache miss      ParseCached() with an empty cache directory, which parses
+                    and writes the cache file,
+    cache hit       ParseCached() with the file in place,
+
+and the shortest command line for which a hit is faster than Parse().  Each
+run registers the options on a new CommandLineOptions, as a new process would,
+but only the parse is timed.  The cache files stay in the page cache, as they
+would when a tool is run repeatedly.
+
+BUILDING
+========
+
+There is no build script; compile this file on its own.  It is POSIX-only:
+
+    c++ -O2 -std=c++17 -I.. clover_cache.cpp -o clover_cache
+    ./clover_cache --cache-dir=/tmp/clover_cache
+
+Run "clover_cache --help" for options.
+*/
+#define CLOVER_IMPLEMENTATION
+#include "clover.h"
+
+#include <algorithm>
+#include <memory>
+#include <string>
+#include <vector>
+#include <dirent.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+static uint64_t NowNs()
+{
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000ull + (uint64_t) ts.tv_nsec;
+}
+
+// -----------------------------------------------------------------------------
+// Schema and command lines
+
+// The option values of one run.  Every third option is a flag, a uint32_t or
+// a string.
+struct Values {
+    std::unique_ptr<bool[]> bools_;
+    std::unique_ptr<uint32_t[]> uints_;
+    std::unique_ptr<char*[]> strings_;
+};
+
+static void AddOptions(CommandLineOptionsT<char>* opts, std::vector<std::string> const& names, Values* values)
+{
+    auto count = names.size();
+    values->bools_.reset(new bool[count]());
+    values->uints_.reset(new uint32_t[count]());
+    values->strings_.reset(new char*[count]());
+    for (size_t i = 0; i < count; ++i) {
+        auto name = names[i].c_str();
+        switch (i % 3) {
+        case 0:  opts->AddOption(&values->bools_[i], name, "Synthetic bool option."); break;
+        case 1:  opts->AddOption(&values->uints_[i], name, "N", "Synthetic uint32 option."); break;
+        default: opts->AddOption(&values->strings_[i], name, "STR", "Synthetic string option."); break;
+        }
+    }
+}
+
+static std::vector<std::string> GenerateNames(uint32_t optionCount)
+{
+    std::vector<std::string> names;
+    for (uint32_t i = 0; i < optionCount; ++i) {
+        auto n = std::to_string(i);
+        switch (i % 3) {
+        case 0:  names.emplace_back("flag-" + n); break;
+        case 1:  names.emplace_back("count-" + n); break;
+        default: names.emplace_back("name-" + n); break;
+        }
+    }
+    return names;
+}
+
+// argCount arguments, cycling through the options.
+static std::vector<std::string> GenerateArguments(std::vector<std::string> const& names, uint32_t argCount)
+{
+    std::vector<std::string> args;
+    args.emplace_back("clover_cache");
+    for (uint32_t i = 0; i < argCount; ++i) {
+        auto o = i % (uint32_t) names.size();
+        switch (o % 3) {
+        case 0:  args.emplace_back("--" + names[o]); break;
+        case 1:  args.emplace_back("--" + names[o] + "=" + std::to_string(i)); break;
+        default: args.emplace_back("--" + names[o] + "=value-" + std::to_string(i)); break;
+        }
+    }
+    return args;
+}
+
+static bool ClearDirectory(std::string const& dir)
+{
+    DIR* d = opendir(dir.c_str());
+    if (d == nullptr) {
+        return false;
+    }
+    while (dirent* entry = readdir(d)) {
+        if (strcmp(entry->d_name, ".") != 0 && strcmp(entry->d_name, "..") != 0) {
+            unlink((dir + "/" + entry->d_name).c_str());
+        }
+    }
+    closedir(d);
+    return true;
+}
+
+// -----------------------------------------------------------------------------
+// Measurement
+
+enum Mode {
+    Mode_Parse,
+    Mode_CacheMiss,
+    Mode_CacheHit,
+    Mode_Count,
+};
+
+// Times one parse of args over a new instance of the schema.  Returns false if
+// it didn't succeed.
+static bool Run(Mode mode, std::vector<std::string> const& names, std::vector<std::string> const& args, std::string const& dir, uint64_t* ns)
+{
+    if (mode == Mode_CacheMiss && !ClearDirectory(dir)) {
+        return false;
+    }
+
+    Values values;
+    CommandLineOptionsT<char> opts;
+    AddOptions(&opts, names, &values);
+    std::vector<char*> argv;
+    for (auto const& a : args) {
+        argv.emplace_back((char*) a.c_str());
+    }
+    argv.emplace_back(nullptr);
+
+    int errorArgIndex = 0;
+    auto start = NowNs();
+    auto result = mode == Mode_Parse ? opts.Parse((int) args.size(), argv.data(), &errorArgIndex)
+                                     : opts.ParseCached(dir.c_str(), (int) args.size(), argv.data(), &errorArgIndex);
+    *ns = NowNs() - start;
+    return result == CommandLineOptions_Ok;
+}
+
+static double Percentile(std::vector<uint64_t> durations, double p)
+{
+    std::sort(durations.begin(), durations.end());
+    auto i = (size_t) (p * (double) (durations.size() - 1) + 0.5);
+    return (double) durations[i] / 1000.0;
+}
+
+int main(int argc, char** argv)
+{
+    char* cacheDir = nullptr;
+    uint32_t optionCount = 1000;
+    uint32_t runs = 50;
+
+    CommandLineOptionsT<char> opts;
+    opts.AddOption(&cacheDir,    "cache-dir", "DIR", "Directory for the cache files (default: clover_cache.tmp).");
+    opts.AddOption(&optionCount, "options",   "N",   "Number of options in the schema (default: 1000).");
+    opts.AddOption(&runs,        "runs",      "N",   "Number of measured runs per mode and command line (default: 50).");
+
+    int errorArgIndex = 0;
+    switch (opts.Parse(argc, argv, &errorArgIndex)) {
+    case CommandLineOptions_Ok: break;
+    case CommandLineOptions_HelpRequested:
+        opts.PrintUsage();
+        return 0;
+    default:
+        fprintf(stderr, "error: invalid command line argument: %s.\n", argv[errorArgIndex]);
+        opts.PrintUsage();
+        return 1;
+    }
+
+    std::string dir = cacheDir != nullptr ? cacheDir : "clover_cache.tmp";
+    optionCount = std::max(optionCount, 1u);
+    runs = std::max(runs, 1u);
+    if (mkdir(dir.c_str(), 0755) != 0 && errno != EEXIST) {
+        fprintf(stderr, "error: failed to create %s.\n", dir.c_str());
+        return 1;
+    }
+
+    static char const* const kModeNames[Mode_Count] = { "parse", "cache miss", "cache hit" };
+    auto names = GenerateNames(optionCount);
+    uint32_t crossover = 0;
+
+    printf("%u options, %u runs (microseconds):\n", optionCount, runs);
+    printf("    %-10s %-12s %10s %10s %10s %10s\n", "args", "mode", "min", "p50", "p90", "max");
+    for (uint32_t argCount : { 1u, 2u, 5u, 10u, 20u, 50u, 100u, 200u, 500u, 1000u, 2000u, 5000u, 10000u, 20000u }) {
+        auto args = GenerateArguments(names, argCount);
+        auto runDir = dir + "/args_" + std::to_string(argCount);
+        if (mkdir(runDir.c_str(), 0755) != 0 && errno != EEXIST) {
+            fprintf(stderr, "error: failed to create %s.\n", runDir.c_str());
+            return 1;
+        }
+
+        // The first run of each mode is a warmup, and leaves the cache file in
+        // place for the hits.
+        double medians[Mode_Count] = {};
+        for (int mode = 0; mode < Mode_Count; ++mode) {
+            std::vector<uint64_t> durations;
+            for (uint32_t i = 0; i <= runs; ++i) {
+                uint64_t ns = 0;
+                if (!Run((Mode) mode, names, args, runDir, &ns)) {
+                    fprintf(stderr, "error: parsing %u arguments failed.\n", argCount);
+                    return 1;
+                }
+                if (i > 0) {
+                    durations.emplace_back(ns);
+                }
+            }
+            medians[mode] = Percentile(durations, 0.5);
+            printf("    %-10u %-12s %10.1f %10.1f %10.1f %10.1f\n", argCount, kModeNames[mode],
+                   Percentile(durations, 0.0), medians[mode], Percentile(durations, 0.9), Percentile(durations, 1.0));
+        }
+        fflush(stdout);
+
+        if (crossover == 0 && medians[Mode_CacheHit] < medians[Mode_Parse]) {
+            crossover = argCount;
+        }
+        ClearDirectory(runDir);
+        rmdir(runDir.c_str());
+    }
+
+    if (crossover != 0) {
+        printf("cache hits are faster than Parse() (by median) from %u arguments.\n", crossover);
+    } else {
+        printf("cache hits weren't faster than Parse() for any command line measured.\n");
+    }
+    return 0;
+}
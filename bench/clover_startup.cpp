@@ -0,0 +1,312 @@
+/*
+Clover startup latency harness - measures what clover adds to process startup.
+
+The parse loop is only part of the startup cost of a clover-based tool, so this
+harness builds minimal executables that register 10, 100 and 1000 options, execs
+each of them many times, and reports percentiles of:
+
+    exec-to-main    posix_spawn() until main() is entered (loader, static
+                    initialization),
+    registration    the AddOption() calls,
+    parse           Parse() over a short command line,
+    output          the first write to stdout and a PrintUsage() call,
+    exec-to-return  posix_spawn() until main() returns,
+    exit            main() returning until the process is reaped.
+
+Each generated executable writes CLOCK_MONOTONIC timestamps for its phases to
+file descriptor 3, which the harness connects to a pipe.
+
+BUILDING
+========
+
+There is no build script; compile this file on its own.  It is POSIX-only, and
+needs a C++ compiler at run time to build the executables it measures:
+
+    c++ -O2 -std=c++17 -I.. clover_startup.cpp -o clover_startup
+    ./clover_startup --clover-dir=.. --work-dir=/tmp/clover_startup
+
+Run "clover_startup --help" for options.
+*/
+#define CLOVER_IMPLEMENTATION
+#include "clover.h"
+
+#include <algorithm>
+#include <string>
+#include <vector>
+#include <errno.h>
+#include <fcntl.h>
+#include <spawn.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+extern char** environ;
+
+static uint64_t NowNs()
+{
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000ull + (uint64_t) ts.tv_nsec;
+}
+
+// -----------------------------------------------------------------------------
+// Generated executables
+
+// The timestamps an executable reports, in order.
+enum Timestamp {
+    Timestamp_MainEntered,
+    Timestamp_Registered,
+    Timestamp_Parsed,
+    Timestamp_Output,
+    Timestamp_MainReturning,
+    Timestamp_Count,
+};
+
+static std::string GenerateSource(uint32_t optionCount)
+{
+    std::string src;
+    src += "#define CLOVER_IMPLEMENTATION\n"
+           "#include \"clover.h\"\n"
+           "#include <time.h>\n"
+           "#include <unistd.h>\n"
+           "\n"
+           "static uint64_t NowNs()\n"
+           "{\n"
+           "    timespec ts;\n"
+           "    clock_gettime(CLOCK_MONOTONIC, &ts);\n"
+           "    return (uint64_t) ts.tv_sec * 1000000000ull + (uint64_t) ts.tv_nsec;\n"
+           "}\n"
+           "\n";
+    src += "static bool     gBools[" + std::to_string(optionCount) + "];\n";
+    src += "static uint32_t gUints[" + std::to_string(optionCount) + "];\n";
+    src += "static char*    gStrings[" + std::to_string(optionCount) + "];\n";
+    src += "\n"
+           "int main(int argc, char** argv)\n"
+           "{\n"
+           "    uint64_t t[5];\n"
+           "    t[0] = NowNs();\n"
+           "\n"
+           "    CommandLineOptions opts;\n";
+    for (uint32_t i = 0; i < optionCount; ++i) {
+        auto n = std::to_string(i);
+        switch (i % 3) {
+        case 0:  src += "    opts.AddOption(&gBools[" + n + "], \"flag-" + n + "\", \"Synthetic bool option " + n + ".\");\n"; break;
+        case 1:  src += "    opts.AddOption(&gUints[" + n + "], \"count-" + n + "\", \"N\", \"Synthetic uint32 option " + n + ".\");\n"; break;
+        default: src += "    opts.AddOption(&gStrings[" + n + "], \"name-" + n + "\", \"STR\", \"Synthetic string option " + n + ".\");\n"; break;
+        }
+    }
+    src += "    t[1] = NowNs();\n"
+           "\n"
+           "    int errorArgIndex = 0;\n"
+           "    auto result = opts.Parse(argc, argv, &errorArgIndex);\n"
+           "    t[2] = NowNs();\n"
+           "\n"
+           "    printf(\"result=%d\\n\", (int) result);\n"
+           "    opts.PrintUsage(stdout);\n"
+           "    fflush(stdout);\n"
+           "    t[3] = NowNs();\n"
+           "\n"
+           "    t[4] = NowNs();\n"
+           "    if (write(3, t, sizeof(t)) != (ssize_t) sizeof(t)) {\n"
+           "        return 1;\n"
+           "    }\n"
+           "    return 0;\n"
+           "}\n";
+    return src;
+}
+
+// A short command line that matches options present in every schema.
+static std::vector<std::string> GenerateArguments(uint32_t optionCount)
+{
+    std::vector<std::string> args;
+    for (uint32_t i = 0; i < std::min(optionCount, 9u); ++i) {
+        auto n = std::to_string(i);
+        switch (i % 3) {
+        case 0:  args.emplace_back("--flag-" + n); break;
+        case 1:  args.emplace_back("--count-" + n + "=" + n); break;
+        default: args.emplace_back("--name-" + n + "=value"); break;
+        }
+    }
+    return args;
+}
+
+static bool Build(char const* cxx, char const* cloverDir, std::string const& srcPath, std::string const& exePath)
+{
+    auto command = std::string(cxx) + " -O2 -std=c++17 -I'" + cloverDir + "' '" + srcPath + "' -o '" + exePath + "'";
+    printf("building: %s\n", command.c_str());
+    fflush(stdout);
+    return system(command.c_str()) == 0;
+}
+
+// -----------------------------------------------------------------------------
+// Measurement
+
+struct Sample {
+    uint64_t spawn_;
+    uint64_t t_[Timestamp_Count];
+    uint64_t reaped_;
+};
+
+static bool Run(std::string const& exePath, std::vector<std::string> const& args, int devNull, Sample* sample)
+{
+    int fds[2];
+    if (pipe(fds) != 0) {
+        return false;
+    }
+
+    std::vector<char*> argv;
+    argv.emplace_back((char*) exePath.c_str());
+    for (auto const& a : args) {
+        argv.emplace_back((char*) a.c_str());
+    }
+    argv.emplace_back(nullptr);
+
+    posix_spawn_file_actions_t actions;
+    posix_spawn_file_actions_init(&actions);
+    posix_spawn_file_actions_adddup2(&actions, devNull, STDOUT_FILENO);
+    posix_spawn_file_actions_adddup2(&actions, fds[1], 3);
+    posix_spawn_file_actions_addclose(&actions, fds[0]);
+
+    pid_t pid = 0;
+    sample->spawn_ = NowNs();
+    int err = posix_spawn(&pid, exePath.c_str(), &actions, nullptr, argv.data(), environ);
+    posix_spawn_file_actions_destroy(&actions);
+    close(fds[1]);
+    if (err != 0) {
+        close(fds[0]);
+        return false;
+    }
+
+    size_t received = 0;
+    while (received < sizeof(sample->t_)) {
+        auto n = read(fds[0], (char*) sample->t_ + received, sizeof(sample->t_) - received);
+        if (n <= 0) {
+            break;
+        }
+        received += (size_t) n;
+    }
+    close(fds[0]);
+
+    int status = 0;
+    waitpid(pid, &status, 0);
+    sample->reaped_ = NowNs();
+
+    return received == sizeof(sample->t_) && WIFEXITED(status) && WEXITSTATUS(status) == 0;
+}
+
+static void ReportPhase(char const* name, std::vector<uint64_t> durations)
+{
+    std::sort(durations.begin(), durations.end());
+    auto Percentile = [&durations](double p) {
+        auto i = (size_t) (p * (double) (durations.size() - 1) + 0.5);
+        return (double) durations[i] / 1000.0;
+    };
+    printf("    %-16s %10.1f %10.1f %10.1f %10.1f %10.1f\n", name,
+           Percentile(0.0), Percentile(0.5), Percentile(0.9), Percentile(0.99), Percentile(1.0));
+}
+
+int main(int argc, char** argv)
+{
+    char* cxx = nullptr;
+    char* cloverDir = nullptr;
+    char* workDir = nullptr;
+    uint32_t runs = 1000;
+    uint32_t warmupRuns = 20;
+
+    CommandLineOptionsT<char> opts;
+    opts.AddOption(&cxx,        "cxx",        "PATH", "C++ compiler used to build the executables (default: $CXX or c++).");
+    opts.AddOption(&cloverDir,  "clover-dir", "DIR",  "Directory containing clover.h (default: ..).");
+    opts.AddOption(&workDir,    "work-dir",   "DIR",  "Directory for the generated sources and executables (default: clover_startup.tmp).");
+    opts.AddOption(&runs,       "runs",       "N",    "Number of measured runs per executable (default: 1000).");
+    opts.AddOption(&warmupRuns, "warmup",     "N",    "Number of unmeasured runs per executable (default: 20).");
+
+    int errorArgIndex = 0;
+    switch (opts.Parse(argc, argv, &errorArgIndex)) {
+    case CommandLineOptions_Ok: break;
+    case CommandLineOptions_HelpRequested:
+        opts.PrintUsage();
+        return 0;
+    default:
+        fprintf(stderr, "error: invalid command line argument: %s.\n", argv[errorArgIndex]);
+        opts.PrintUsage();
+        return 1;
+    }
+
+    if (cxx == nullptr) {
+        cxx = getenv("CXX");
+    }
+    std::string compiler   = cxx       != nullptr ? cxx       : "c++";
+    std::string includeDir = cloverDir != nullptr ? cloverDir : "..";
+    std::string dir        = workDir   != nullptr ? workDir   : "clover_startup.tmp";
+    runs = std::max(runs, 1u);
+
+    if (mkdir(dir.c_str(), 0755) != 0 && errno != EEXIST) {
+        fprintf(stderr, "error: failed to create %s.\n", dir.c_str());
+        return 1;
+    }
+
+    int devNull = open("/dev/null", O_WRONLY);
+    if (devNull == -1) {
+        fprintf(stderr, "error: failed to open /dev/null.\n");
+        return 1;
+    }
+
+    for (uint32_t optionCount : { 10u, 100u, 1000u }) {
+        auto base    = dir + "/startup_" + std::to_string(optionCount);
+        auto srcPath = base + ".cpp";
+        auto exePath = base;
+
+        auto src = GenerateSource(optionCount);
+        FILE* fp = fopen(srcPath.c_str(), "w");
+        if (fp == nullptr || fwrite(src.data(), 1, src.size(), fp) != src.size()) {
+            fprintf(stderr, "error: failed to write %s.\n", srcPath.c_str());
+            return 1;
+        }
+        fclose(fp);
+
+        if (!Build(compiler.c_str(), includeDir.c_str(), srcPath, exePath)) {
+            fprintf(stderr, "error: failed to build %s.\n", exePath.c_str());
+            return 1;
+        }
+
+        auto args = GenerateArguments(optionCount);
+        std::vector<Sample> samples;
+        samples.reserve(runs);
+        for (uint32_t i = 0; i < warmupRuns + runs; ++i) {
+            Sample sample;
+            if (!Run(exePath, args, devNull, &sample)) {
+                fprintf(stderr, "error: failed to run %s.\n", exePath.c_str());
+                return 1;
+            }
+            if (i >= warmupRuns) {
+                samples.emplace_back(sample);
+            }
+        }
+
+        std::vector<uint64_t> preMain, registration, parse, output, total, exitTime;
+        for (auto const& s : samples) {
+            preMain.emplace_back(s.t_[Timestamp_MainEntered] - s.spawn_);
+            registration.emplace_back(s.t_[Timestamp_Registered] - s.t_[Timestamp_MainEntered]);
+            parse.emplace_back(s.t_[Timestamp_Parsed] - s.t_[Timestamp_Registered]);
+            output.emplace_back(s.t_[Timestamp_Output] - s.t_[Timestamp_Parsed]);
+            total.emplace_back(s.t_[Timestamp_MainReturning] - s.spawn_);
+            exitTime.emplace_back(s.reaped_ - s.t_[Timestamp_MainReturning]);
+        }
+
+        printf("%u options, %zu arguments, %u runs (microseconds):\n", optionCount, args.size(), runs);
+        printf("    %-16s %10s %10s %10s %10s %10s\n", "phase", "min", "p50", "p90", "p99", "max");
+        ReportPhase("exec-to-main", preMain);
+        ReportPhase("registration", registration);
+        ReportPhase("parse", parse);
+        ReportPhase("output", output);
+        ReportPhase("exec-to-return", total);
+        ReportPhase("exit", exitTime);
+        fflush(stdout);
+    }
+
+    close(devNull);
+    return 0;
+}
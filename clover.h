@@ -22,12 +22,40 @@ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
 OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
 SOFTWARE.
 */
-#pragma once
+#ifndef CLOVER_H
+#define CLOVER_H
 
-// To use char-based arguments, define CLOVER_USE_WCHAR_T=0
-// before including opts.h
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+// CommandLineOptions is wchar_t-based on Windows and char-based elsewhere.  To
+// override, define CLOVER_USE_WCHAR_T=0 or 1 before including clover.h.  Use
+// CommandLineOptionsT<char> or CommandLineOptionsT<wchar_t> directly to pick
+// the character type per instance instead.
 #ifndef CLOVER_USE_WCHAR_T
+#ifdef _WIN32
 #define CLOVER_USE_WCHAR_T 1
+#else
+#define CLOVER_USE_WCHAR_T 0
+#endif
+#endif
+
+// Define CLOVER_ENABLE_RUNTIME=1 before including clover.h to declare the
+// options that can change at run time (see LIVE OPTIONS below).
+#ifndef CLOVER_ENABLE_RUNTIME
+#define CLOVER_ENABLE_RUNTIME 0
+#endif
+
+#if CLOVER_ENABLE_RUNTIME
+#include <atomic>
+#endif
+
+// Define CLOVER_ENABLE_STRING_VIEW=1 before including clover.h to convert
+// std::basic_string_view option values (see OPTION TYPES below).
+#ifndef CLOVER_ENABLE_STRING_VIEW
+#define CLOVER_ENABLE_STRING_VIEW 0
 #endif
 
 /*
@@ -53,25 +81,38 @@ EXAMPLE USAGE
         opts.PrintUsage();
         return 0;
     case CommandLineOptions_ErrorArgumentExpectingValue:
-        fprintf(stderr, "error: command line argument expecting value: %ls.\n", argv[errorArgIndex]);
+        fprintf(stderr, "error: command line argument expecting value: %s.\n", argv[errorArgIndex]);
         opts.PrintUsage();
         return 1;
     case CommandLineOptions_ErrorArgumentValueInvalid:
-        fprintf(stderr, "error: invalid command line argument value: %ls.\n", argv[errorArgIndex]);
+        fprintf(stderr, "error: invalid command line argument value: %s.\n", argv[errorArgIndex]);
         opts.PrintUsage();
         return 1;
     case CommandLineOptions_ErrorUnrecognisedArgument:
-        fprintf(stderr, "error: unrecognised command line argument: %ls.\n", argv[errorArgIndex]);
+        fprintf(stderr, "error: unrecognised command line argument: %s.\n", argv[errorArgIndex]);
+        opts.PrintUsage();
+        return 1;
+    case CommandLineOptions_ErrorAmbiguousArgument:
+        fprintf(stderr, "error: ambiguous command line argument: %s.\n", argv[errorArgIndex]);
         opts.PrintUsage();
         return 1;
+    case CommandLineOptions_ErrorConstraintViolated:
+        opts.PrintError(stderr, CommandLineOptions_ErrorConstraintViolated, nullptr);
+        return 1;
     }
 
+Or, for the errors, use PrintError() (see SUGGESTIONS below):
+
+    default:
+        opts.PrintError(stderr, result, argv[errorArgIndex]);
+        return 1;
+
 
 MATCHING COMMAND LINE ARGUMENTS
 ===============================
 
 An option will match with a command line argument "-NAME=...", "--NAME=...", or
-"/NAME=...", ignoring case, with the following exceptions:
+"/NAME=...", ignoring (ASCII) case, with the following exceptions:
 
     - bool options do not use the "=..." part.
 
@@ -80,6 +121,119 @@ An option will match with a command line argument "-NAME=...", "--NAME=...", or
       they match command line arguments in the same order they were added to
       the CommandLineOptions instance.
 
+SetShortName() gives an option a single (ASCII) character alias, matched with
+case, in the POSIX style:
+
+    opts.SetShortName(opts.AddOption(&verbose, "verbose", "Print more stuff."), 'v');
+    opts.SetShortName(opts.AddOption(&jobs, "jobs", "N", "Run N jobs."), 'j');
+    opts.SetShortName(opts.AddOption(&out, "out", "PATH", "Output path."), 'o');
+
+An argument starting with a single "-" is first matched as a name as above.
+Otherwise its characters are short names: "-vv" sets verbose twice, and a
+short option that takes a value uses the rest of the argument ("-j8", "-vj=8")
+or, if there is nothing left, the next argument ("-o file").  "-h" and "-?"
+always request help.
+
+With SetParseFlags(CommandLineOptions_ParseAbbreviations), a NAME that isn't
+an option's name (or, after a single "-", a cluster of short names) may be a
+prefix of one, as with getopt_long(): "--verb" matches "--verbose" unless
+another option's name also starts with "verb".  In that case Parse() returns
+CommandLineOptions_ErrorAmbiguousArgument, and GetAmbiguousOptions() returns
+the options it could have been.  Abbreviations are only matched on the command
+line, and a subcommand starts with the flags of the options it was found in.
+
+SHELL COMPLETION
+================
+
+Parse() answers shell completion requests.  When argv[1] is
+"--clover-complete=INDEX", it prints the completions of argv[2+INDEX] given
+the arguments before it, one per line, to stdout and calls exit(0), so none of
+the program runs beyond adding its options.  It completes:
+
+    - option names, from the same sorted names as abbreviations (options not
+      included in usage are left out),
+    - the values of options with SetValueChoices(),
+    - file names for the values of other options that take one, and for
+      arguments if there are CharT* options with valueDesc==nullptr,
+    - subcommand names, and the options of a subcommand after its name.
+
+PrintCompletionScript() prints a script that hooks this up for bash, zsh or
+fish, e.g., for a program that prints it when run with --completion-script:
+
+    eval "$(tool --completion-script=bash)"           # ~/.bashrc
+    tool --completion-script=fish | source            # ~/.config/fish/config.fish
+
+SetValueChoices() also restricts the values Parse() accepts, ignoring case:
+
+    static char const* const kModes[] = { "fast", "safe", "paranoid" };
+    opts.SetValueChoices(opts.AddOption(&mode, "mode", "MODE", "Checking mode."), kModes, 3);
+
+CONSTRAINTS
+===========
+
+Relationships between options can be declared instead of checked by hand:
+
+    CommandLineOptionHandle const tls[] = { tlsCert };
+    opts.AddRequires(tlsKey, tls, 1);           // --tls-key needs --tls-cert
+    CommandLineOptionHandle const io[] = { directIo, mmap };
+    opts.AddConflicts(io, 2);                   // at most one of them
+    CommandLineOptionHandle const modes[] = { server, client };
+    opts.AddOneOf(modes, 2);                    // exactly one of them
+
+Once all the arguments are parsed, Parse() checks the constraints against the
+options found by any source so far, and returns
+CommandLineOptions_ErrorConstraintViolated if one doesn't hold.  The error's
+argument is the one that set the offending option (e.g., the later of two
+conflicting options), or 0 if there isn't one (e.g., no option of a one-of
+constraint was found).  Resolve() checks them after applying every source
+instead.  PrintError() describes every constraint the last check found
+violated, so when collecting errors, it only needs calling for the first.
+
+Each constraint is a bitset over the options, so checking one is a few word
+operations per 64 options, however many there are.  GetArgIndex() returns the
+argument that set an option.
+
+COLLECTING ERRORS
+=================
+
+Parse() stops at the first error.  To report every problem with a command line
+at once, pass a buffer for the errors instead:
+
+    CommandLineOptionsError errors[16];
+    uint32_t errorCount = 0;
+    if (opts.Parse(argc, argv, errors, 16, &errorCount) != CommandLineOptions_Ok) {
+        for (uint32_t i = 0; i < errorCount && i < 16; ++i) {
+            opts.PrintError(stderr, errors[i].result_, argv[errors[i].argIndex_]);
+        }
+    }
+
+Arguments with errors are skipped, and parsing carries on with the next one.
+Errors past the end of the buffer are counted but not stored, so nothing is
+allocated per error.  A help argument still stops parsing.
+
+SUGGESTIONS
+===========
+
+GetSuggestions() finds the options whose names are within an edit distance
+(Levenshtein distance, ignoring case) of maxDistance from the name in an
+unrecognised argument, and PrintError() reports them:
+
+    error: unrecognised command line argument: --verbsoe.
+    did you mean --verbose?
+
+PrintError() also considers the options of the instances enclosing the chosen
+subcommand, which it accepts too, and, for an argument without a prefix, the
+names of its subcommands:
+
+    error: unrecognised command line argument: biuld.
+    did you mean build?
+
+Each name is compared against the argument with Myers' bit-parallel algorithm,
+which handles a character of the name per step for argument names of up to 64
+characters (longer ones get no suggestions).  Names whose length differs by
+more than maxDistance are skipped, and a comparison stops early once it can no
+longer beat the current candidates.
+
 PRINTING USAGE
 ==============
 
@@ -89,6 +243,10 @@ Usage is printed in the following format:
         --NAME=VALUEDESC DESCRIPTION
         ...
 
+EXE_NAME is the module file name (without ".exe") on Windows.  Elsewhere it is
+the file name part of the argv[0] passed to Parse(), or the name the C library
+recorded at startup if Parse() hasn't been called.
+
 ARGUMENTS is a space-separated list of CharT* options that have valueDesc==nullptr (if any).
 
 The lines after "options:" correspond to AddOption() and AddUsageNewLine()
@@ -98,6 +256,424 @@ called.  Exceptions to the general option format above include:
     - bool options do not include the "=VALUEDESC" part.
 
     - CharT* options with a valueDesc==nullptr print "NAME DESCRIPTION".
+
+    - Options with a short name print "-C, --NAME=VALUEDESC DESCRIPTION", and
+      the others are indented to line up with them.
+
+AddUsageSection() starts a named group of options, printed after a blank line
+and a "TITLE:" line.
+
+Searching usage
+---------------
+
+"--help=TERM" also returns CommandLineOptions_HelpRequested, after which
+PrintUsage() only prints the options that match TERM (PrintUsage() with a term
+does the same directly).  An option matches if each word in TERM starts one of
+the words of its name, its description or the title of its section, ignoring
+case, so "--help=tls" lists the options mentioning TLS and "--help=network"
+lists a "Network" section.  The words are looked up in an index that is built
+the first time a term is searched for.
+
+
+BUILDING
+========
+
+This header only declares the CommandLineOptions interface, so it can be
+included from any number of source files.  In exactly one source file, define
+CLOVER_IMPLEMENTATION before including it to compile the implementation:
+
+    #define CLOVER_IMPLEMENTATION
+    #include "clover.h"
+
+The implementation pulls in <vector>, <string> and the platform headers it
+needs; the rest of the program only sees <stddef.h>, <stdint.h>, <stdio.h> and
+<string.h> (and <atomic> if CLOVER_ENABLE_RUNTIME=1, and <string_view> if
+CLOVER_ENABLE_STRING_VIEW=1).  Clover requires C++17.
+
+
+CHARACTER TYPES
+===============
+
+CommandLineOptions is an alias for CommandLineOptionsT<char> or
+CommandLineOptionsT<wchar_t> (see CLOVER_USE_WCHAR_T above).  Both are compiled
+by the implementation, so one program can parse native char argv and wide
+strings from another API side by side without converting either.  Character
+specific operations (case folding, numeric parsing and output) are provided by
+CommandLineOptionsTraits<CharT>.
+
+
+ENVIRONMENT VARIABLES
+=====================
+
+ParseEnvironment(prefix) sets options from environment variables named by the
+prefix followed by the option name.  For example, with the prefix "APP_" the
+option "threads" is set by APP_THREADS=32.  Names are matched ignoring ASCII
+case, and "-" or "." in an option name matches "_" in the variable name.
+
+The environment is scanned once, looking each variable up in the option index
+(a hash table over the option names, which is also used by Parse()).  Values
+are converted in the same way as Parse() does, and bool options additionally
+take a value of 1/0, true/false, yes/no or on/off.
+
+The command line takes precedence over the environment (see OPTION SOURCES
+below).  WasFound() also reports options set from the environment.  CharT*
+values point into the environment block, so they are only valid until the
+environment is modified.
+
+
+CONFIG FILES
+============
+
+ParseConfigFile(path) sets options from a file of "NAME=VALUE" lines:
+
+    # Comments start with '#' or ';'.
+    threads = 32
+    verbose
+    [net]
+    port = 8080
+
+Whitespace around names and values is ignored, and a value may be enclosed in
+double quotes to keep surrounding whitespace.  A bool option may be given
+without a value (meaning true), or with any of the values ParseEnvironment()
+accepts.  A "[SECTION]" line prefixes the names on the lines that follow with
+"SECTION.", so the port above sets the option named "net.port"; "[]" ends the
+section.
+
+The file is memory-mapped copy-on-write and tokenized in place, names are
+resolved through the same option index as Parse(), and values are converted in
+the same way.  CharT* values point directly into the mapping, which stays valid
+until the CommandLineOptionsT is destroyed.  The file is read as CharT units,
+so CommandLineOptionsT<wchar_t> expects a wide (e.g., UTF-16 on Windows) file;
+a leading byte order mark is skipped.
+
+Config files have the lowest precedence (see OPTION SOURCES below).  If
+several files are parsed, later files override earlier ones.
+
+
+OPTION SOURCES
+==============
+
+An option's effective value comes from the highest priority source that set
+it, whatever order the sources were parsed in:
+
+    CommandLineOptions_SourceCommandLine    Parse()
+    CommandLineOptions_SourceEnvironment    ParseEnvironment()
+    CommandLineOptions_SourceConfigFile     ParseConfigFile()
+    CommandLineOptions_SourceDefault        the value the variable held
+
+Each source records the options it sets in its own bitset, so before a source
+is applied the options set by higher priority sources are combined in one
+O(options/64) pass, and each value it finds only costs a bit test.  Resolve()
+applies the command line, environment and a config file in priority order.
+
+AddOption() returns a CommandLineOptionHandle, which GetSource() takes to
+report where an option's effective value came from.
+
+
+SUBCOMMANDS
+===========
+
+AddSubcommand() adds a git-style subcommand, e.g. "exe [options] build
+[build options]", along with a factory callback that adds the subcommand's own
+options.  Only the subcommand found on the command line is constructed:
+
+    static void AddBuildOptions(CommandLineOptions* build, void* context)
+    {
+        auto config = (Config*) context;
+        build->AddOption(&config->jobs, "jobs", "N", "Number of parallel jobs.");
+    }
+
+    opts.AddSubcommand("build", "Build the project.", AddBuildOptions, &config);
+
+When Parse() reaches an argument not starting with "-", "--", or "/" that
+names a subcommand, it calls the subcommand's factory and parses the remaining
+arguments with the resulting options, which GetSubcommand() returns afterwards.
+The options of the enclosing CommandLineOptionsT remain available as global
+options after the subcommand name.  If Parse() returns
+CommandLineOptions_HelpRequested with a subcommand selected, its PrintUsage()
+prints the subcommand's options followed by the global options.
+
+
+ACTIONS
+=======
+
+AddAction() adds an option that calls a function when it matches, instead of
+storing a value for the program to inspect after Parse():
+
+    opts.AddAction("log-file", "PATH", "Write the log to PATH.", [&](char* path) {
+        log = fopen(path, "w");
+        return log != nullptr;
+    });
+    opts.AddAction<uint32_t>("pool-size", "N", "Size the pool for N items.", [&](uint32_t n) {
+        pool.reserve(n);
+    });
+    opts.AddAction("version", "Print the version.", &PrintVersion);
+
+Without a valueDesc, the action is called with no arguments.  Otherwise it is
+called with the converted value, which is a CharT* unless another type is given
+as a template argument.  If the action returns false, the value is reported as
+CommandLineOptions_ErrorArgumentValueInvalid.  Actions are called from
+ParseEnvironment() and ParseConfigFile() too, where a flag action is called if
+its value is true.
+
+The action is stored inline, so it can be a function pointer or a trivially
+copyable callable (e.g., a lambda capturing a few references) no larger than
+CommandLineOptionsT::Action::kStorageSize bytes; registering it doesn't
+allocate.
+
+OPTION TYPES
+============
+
+AddOption() accepts a pointer to any type with a CommandLineValueTraits
+specialisation, which converts the argument text when the option matches.
+Clover provides specialisations for the integer and floating point types, bool,
+CharT*, CharT const* and, if CLOVER_ENABLE_STRING_VIEW=1 is defined before
+including clover.h, std::basic_string_view<CharT>; integers are parsed with
+base prefixes (e.g., "0x10") and rejected if out of range for their type.
+The converter is chosen when the option is added, so adding a type doesn't
+touch the parser.  For example:
+
+    template<>
+    struct CommandLineValueTraits<std::chrono::milliseconds, char> {
+        static bool Parse(char* text, std::chrono::milliseconds* value)
+        {
+            uint32_t ms = 0;
+            if (!CommandLineValueTraits<uint32_t, char>::Parse(text, &ms)) {
+                return false;
+            }
+            *value = std::chrono::milliseconds(ms);
+            return true;
+        }
+    };
+
+    std::chrono::milliseconds timeout(500);
+    opts.AddOption(&timeout, "timeout", "MS", "Give up after MS milliseconds.");
+
+A bool added with a valueDesc takes a value like other options; without one it
+is a flag.  The same specialisations convert the values passed to actions.
+
+STRUCT BINDING
+==============
+
+CLOVER_DECLARE_OPTIONS declares a struct of option values, with their defaults,
+and a static table of the options from one list, so they can't drift apart:
+
+    #define SERVER_OPTIONS(X) \
+        X(bool,     verbose, "verbose", false,   nullptr, "Print more stuff.") \
+        X(uint32_t, threads, "threads", 4,       "N",     "Number of worker threads.") \
+        X(char*,    logPath, "log",     nullptr, "PATH",  "Write the log to PATH.")
+    CLOVER_DECLARE_OPTIONS(ServerConfig, char, SERVER_OPTIONS);
+
+    ServerConfig config;
+    opts.AddOptions(&config);
+
+Each X() entry is (type, field, name, default, valueDesc, description), and
+adds an option as AddOption(&config.field, name, valueDesc, description)
+would; the type must be a single token or a name without commas (use an alias
+for template types).  The values end up next to each other in the struct, so
+code that reads many of them touches few cache lines.
+
+AddOptions() also accepts a hand-written table of OptionEntry::Make<T>()
+entries with the offsets of the fields in any standard-layout struct.  Either
+way, it reserves space for the whole table up front, and the options are found
+through the same index as the rest.
+
+PARSE CACHE
+===========
+
+A program that is run many times with the same long command line (e.g., by a
+build) can skip matching and converting it after the first time:
+
+    auto result = opts.ParseCached("/tmp/mytool-cache", argc, argv, &errorArgIndex);
+
+ParseCached() hashes the arguments, and the options' names, types and other
+properties that affect parsing, and looks for a file named after the two
+hashes in the directory.  If there is one, it is mapped, checked and copied
+into the options instead of parsing: the file holds the text of the arguments,
+which must match exactly, the set of options found, the argument that set each
+one, and their values.  String values are stored as the argument they point
+into and their offset in it, so they point into argv as usual.  A file that
+doesn't match or is damaged is ignored, and replaced.
+
+Otherwise, the command line is parsed as usual, and if that succeeds the
+result is written to a new file, which is renamed into place so that
+processes running at the same time never see half of one.  Nothing is written
+if any argument was an action, a subcommand or the value of an option whose
+type can't be copied as bytes.  Other values are copied as bytes, so their
+types mustn't point into the arguments' text (as the string types do), or
+elsewhere in the program.  The directory must exist, and should be cleared
+when the program changes in a way the hash can't see, such as a new
+CommandLineValueTraits specialisation.
+
+Constraints are checked each time.  For short command lines, hashing them and
+opening the file costs more than parsing: bench/clover_cache.cpp measures
+where the two cross over.
+
+LIVE OPTIONS
+============
+
+Options that must change while the program runs (e.g., from an admin endpoint)
+can store their values in CommandLineLiveValue<T>, which wraps a std::atomic<T>
+on a cache line of its own.  Live options need <atomic>, so they're only
+declared if CLOVER_ENABLE_RUNTIME=1 is defined before every inclusion of
+clover.h, including the implementation's:
+
+    CommandLineLiveValue<uint32_t> batchSize(64);
+    auto h = opts.AddLiveOption(&batchSize, "batch-size", "N", "Items per batch.");
+    opts.AddWatcher(h, [](CommandLineOptionHandle, void*) { ... });
+
+    // Worker threads, in their loops:
+    auto n = batchSize.Load();
+
+    // The admin thread:
+    if (opts.SetLiveValue(h, "128") != CommandLineOptions_Ok) { ... }
+
+Load() is a relaxed atomic load, so reading a live option costs the same as
+reading a plain one, and no cache line is shared with another value.  Parse()
+and the other sources set live options as usual.  SetLiveValue() converts its
+text with the same CommandLineValueTraits, and checks it against the option's
+choices, as Parse() would; updates are serialised with each other but never
+block readers, and the option's watchers are called on the updating thread
+afterwards, after which the snapshot and shared-memory segment below are
+updated if they exist.  T must be an arithmetic or enum type.
+
+SNAPSHOTS
+=========
+
+Reading several live options one at a time can see some of an update and not
+the rest.  Instead, the thread that parses can publish a snapshot of every
+option's value, and of which options were found, for other threads to read as
+a whole:
+
+    opts.Parse(argc, argv, &errorArgIndex);
+    opts.PublishSnapshot();
+
+    // Each reading thread:
+    auto reader = opts.AddSnapshotReader();
+    ...
+    auto snapshot = reader.Acquire();
+    auto batchSize = *snapshot->Get<uint32_t>(batchSizeHandle);
+    auto verbose = *snapshot->Get<bool>(verboseHandle);
+    reader.Release();
+
+    // Later, on the parsing thread:
+    opts.Parse(newArgc, newArgv, &errorArgIndex);
+    opts.PublishSnapshot();
+
+A snapshot never changes, and Acquire() and Release() are wait-free: the reader
+announces the current epoch, and a snapshot that PublishSnapshot() replaces is
+only freed once no reader announces an epoch from before the replacement.  A
+reader that holds one snapshot for a long time therefore delays freeing the
+ones published after it, but never blocks the publisher.  Each thread needs
+its own SnapshotReader, and must Release() before it Acquire()s again.
+
+Snapshots copy values, so string values still point at the arguments they came
+from, which must outlive the snapshot.  PublishSnapshot() takes the same lock
+as SetLiveValue(); parsing, like adding options, must still happen on one
+thread.
+
+HOT RELOAD
+==========
+
+Options can be changed from a config file while the program runs, without
+restarting it:
+
+    opts.SetReloadable(cacheSizeHandle);
+    opts.SetReloadable(logLevelHandle);
+    opts.StartReloader("/etc/server.conf", [](CommandLineOptionsReload const& reload, void*) {
+        for (uint32_t i = 0; i < reload.rejectedCount_; ++i) {
+            ... // a changed option that needs a restart
+        }
+    });
+
+The reloader watches the file's directory with inotify on a background thread
+(so it is Linux-only, and declared with the live options).  When the file is
+written or replaced, it calls ReloadConfigFile(), which can also be called
+directly.  That tokenizes the file and matches and converts its values exactly
+as ParseConfigFile() does, but into a staging copy: nothing changes if the file
+has an error.  Each value is then compared with the option's current one;
+reloadable options that differ are changed, and the rest that differ are
+reported as rejected.  Options a higher priority source set are left alone, as
+are actions, and options removed from the file keep their values.  The file is
+read into memory rather than mapped, and freed afterwards: a changed string
+value is copied, and its last copy freed once no snapshot can point at it, so
+values of other types mustn't keep pointers into their text.  String values
+that ParseConfigFile() set still point into its mapping, so replace the file
+(e.g., with rename()) rather than rewriting it in place if there are any.
+
+Changes go through the same paths as SetLiveValue(): live options are stored
+atomically, watchers are called, and a new snapshot is published if
+PublishSnapshot() has been called before.  Other threads should read
+reloadable options through live values or snapshots; plain values are simply
+overwritten.  The callback is called with the live options' lock held, so it
+mustn't update them itself.
+
+INCREMENTAL PARSING
+===================
+
+A program that is given a new command line while it runs (e.g., on SIGHUP) can
+parse it with ParseIncremental(), which reports the options whose values
+changed:
+
+    CommandLineOptionHandle changed[16];
+    uint32_t changedCount = 0;
+    opts.ParseIncremental(argc, argv, &errorArgIndex, changed, 16, &changedCount);
+    ...
+    opts.ParseIncremental(newArgc, newArgv, &errorArgIndex, changed, 16, &changedCount);
+
+Each call hashes the arguments and pairs them with identical ones from the last
+call, whose matches are reused; only the others are matched and converted.  An
+option's value then only changes if the argument that decides it does, and an
+option that is no longer given goes back to the value it had before the first
+call, unless another source set it.  Values are compared before they are
+reported, so "--count=8" replacing "--count=0x8" isn't a change.
+
+This only applies when every argument sets a bool or value option by itself
+(e.g., "--name=value" or "-flag"), and the last call's did too.  Otherwise, the
+command line is parsed again in full, after the options only it set are put
+back, and every value is compared afterwards; options whose type can't be
+copied as bytes are reported if they are given either time.  A subcommand's
+options are never reported.
+
+Changes go through the same paths as SetLiveValue(), and ParseIncremental()
+takes the same lock.  String values are pointed at the new arguments, but
+values of other types that keep pointers into their text may still point into
+the last call's arguments, which then have to stay valid.  Call
+ParseIncremental() for the first parse as well, after adding every option.
+
+SHARED MEMORY
+=============
+
+Other processes (e.g., a sidecar or a debugging tool) can read a running
+program's options without asking it, if it publishes them to a POSIX
+shared-memory segment:
+
+    opts.Parse(argc, argv, &errorArgIndex);
+    opts.PublishToSharedMemory("/server.options");
+
+    // In another process:
+    CommandLineSharedOptions shared;
+    if (shared.Open("/server.options") && shared.Read()) {
+        auto i = shared.Find("batch-size");
+        if (i != UINT32_MAX && shared.GetKind(i) == CommandLineOptions_ValueUInt) {
+            auto batchSize = *shared.Get<uint32_t>(i);
+        }
+    }
+
+The segment holds each option's name, handle, value type and value, and
+whether it was found, after a header with the layout's version and the
+character type.  Strings are copied into it, and actions aren't included.
+Live changes rewrite it under a sequence lock: the writer makes the sequence
+number odd while it writes, and a reader retries a copy that saw an odd or
+changed number, so neither side ever waits for the other.  Nothing is written
+when options are read, so they cost the same as without a segment.
+
+The segment grows if the values need more space, and the reader maps it again.
+Its name must start with '/', and some older C libraries need -lrt to link.
+PublishToSharedMemory() fails if a running process already published a segment
+with the name, and replaces any other segment with it: one whose process has
+exited, or one that doesn't name a writer (e.g., left by a crash before the
+first write, or by an older Clover).
 */
 
 enum CommandLineOptionsResult {
@@ -106,263 +682,4923 @@ enum CommandLineOptionsResult {
     CommandLineOptions_ErrorArgumentExpectingValue,
     CommandLineOptions_ErrorArgumentValueInvalid,
     CommandLineOptions_ErrorUnrecognisedArgument,
+    CommandLineOptions_ErrorAmbiguousArgument,
+    CommandLineOptions_ErrorConstraintViolated,
 };
 
-class CommandLineOptions {
-public:
-    #if CLOVER_USE_WCHAR_T
-    using CharT = wchar_t;
-    #else
-    using CharT = char;
-    #endif
+// The shells PrintCompletionScript() supports.
+enum CommandLineOptionsShell {
+    CommandLineOptions_ShellBash,
+    CommandLineOptions_ShellZsh,
+    CommandLineOptions_ShellFish,
+};
 
-    void AddOption(bool*     value, CharT const* name,                         CharT const* description, bool includeInUsage=true);
-    void AddOption(uint32_t* value, CharT const* name, CharT const* valueDesc, CharT const* description, bool includeInUsage=true);
-    void AddOption(CharT**   value, CharT const* name, CharT const* valueDesc, CharT const* description, bool includeInUsage=true);
+// Optional matching behaviour, enabled with SetParseFlags().
+enum CommandLineOptionsParseFlags {
+    CommandLineOptions_ParseAbbreviations = 1 << 0,
+};
 
-    void AddUsageNewLine();
+// Where an option's value came from, in increasing order of priority.
+enum CommandLineOptionsSource {
+    CommandLineOptions_SourceDefault,
+    CommandLineOptions_SourceConfigFile,
+    CommandLineOptions_SourceEnvironment,
+    CommandLineOptions_SourceCommandLine,
+    CommandLineOptions_SourceCount,
+};
 
-    uint32_t GetOptionCount(bool includeNewlines=false) const;
+// Identifies an option added to a CommandLineOptionsT.
+enum class CommandLineOptionHandle : uint32_t {
+    Invalid = 0xffffffff,
+};
 
-    // Print usage (see above). Option descriptions are wrapped at any
-    // whitespace exceeding the line's targetWidth.
-    void PrintUsage(FILE* fp=stderr, int targetWidth=100) const;
+// An error found by the collecting Parse().  option_ is the option the
+// argument matched, or CommandLineOptionHandle::Invalid if it didn't match one.
+struct CommandLineOptionsError {
+    int argIndex_;
+    CommandLineOptionsResult result_;
+    CommandLineOptionHandle option_;
+};
 
-    // Parses the command line arguments.
-    //
-    // If errorArgIndex!=nullptr and the returned
-    // result!=CommandLineOptions_Ok, then that result was caused by the
-    // argument at argv[*errorArgIndex].
-    CommandLineOptionsResult Parse(int argc, CharT** argv, int* errorArgIndex);
+#if CLOVER_ENABLE_RUNTIME
+// What a config file reload did (see HOT RELOAD above).  result_ and
+// errorLine_ are as ParseConfigFile() reports them.  changed_ holds the
+// options whose values it changed, and rejected_ the ones whose values differ
+// but which aren't reloadable.  The arrays are valid until the next reload.
+struct CommandLineOptionsReload {
+    CommandLineOptionsResult result_;
+    int errorLine_;
+    CommandLineOptionHandle const* changed_;
+    uint32_t changedCount_;
+    CommandLineOptionHandle const* rejected_;
+    uint32_t rejectedCount_;
+};
 
-    // After Parse() has been called, returns whether a particular option
-    // matched an argument in the command line.
-    bool WasFound(CharT const* name) const;
+// The types of the values in a shared-memory segment (see SHARED MEMORY
+// above).  Other values are copied as bytes, if they can be.
+enum CommandLineOptionsValueKind {
+    CommandLineOptions_ValueOther,
+    CommandLineOptions_ValueBool,
+    CommandLineOptions_ValueInt,
+    CommandLineOptions_ValueUInt,
+    CommandLineOptions_ValueFloat,
+    CommandLineOptions_ValueString,
+};
+#endif
 
-private:
-    struct Option {
-        CharT const* name_;
-        CharT const* valueDesc_;
-        CharT const* description_;
-        void* value_;
-        enum { NEWLINE, ARG, BOOL, UINT32, STRING, } type_;
-        bool includeInUsage_;
-        bool found_;
-    };
+// Character-type specific operations used by CommandLineOptionsT, specialised
+// for char and wchar_t.
+//
+// FoldCase() is used to match option names.  It does plain ASCII case folding,
+// which avoids the locale lookups done by _stricmp()/strcasecmp() and their
+// wide versions.
+//
+// ParseInt64(), ParseUInt64(), ParseDouble() and ParseBool() return false if
+// the string is not entirely a valid value in range.  ParseBool() accepts
+// 1/0, true/false, yes/no and on/off, ignoring case.
+//
+// GetEnvironment() returns the process environment as an array of "NAME=VALUE"
+// strings, or nullptr if it isn't available in this character type.
+//
+// The output functions return the number of characters written.
+// PrintNarrow() writes a char string (e.g., a literal) to the stream.
+template<typename CharT>
+struct CommandLineOptionsTraits;
 
-    std::vector<Option> options_;
+template<>
+struct CommandLineOptionsTraits<char> {
+    static char FoldCase(char c) { return (c >= 'A' && c <= 'Z') ? (char) (c + ('a' - 'A')) : c; }
+    static size_t Length(char const* s);
+    static bool ParseInt64(char const* s, int64_t* value);
+    static bool ParseUInt64(char const* s, uint64_t* value);
+    static bool ParseDouble(char const* s, double* value);
+    static bool ParseBool(char const* s, bool* value);
+    static char** GetEnvironment();
+    static int Print(FILE* fp, char const* s);
+    static int Print(FILE* fp, char c);
+    static int PrintNarrow(FILE* fp, char const* s);
 };
 
-#if CLOVER_USE_WCHAR_T
-#define CLOVER_MAKESTR(_A)          L ## _A
-#define CLOVER_stricmp(_A, _B)      _wcsicmp(_A, _B) == 0
-#define CLOVER_strnicmp(_A, _B, _C) _wcsnicmp(_A, _B, _C) == 0
-#define CLOVER_strlen(_A)           wcslen(_A)
-#define CLOVER_strtoul(_A, _B, _C)  wcstoul(_A, _B, _C)
-#define CLOVER_fprintf(_A, ...)     fwprintf(fp, L ## _A, __VA_ARGS__)
-#else
-#define CLOVER_MAKESTR(_A)          _A
-#define CLOVER_stricmp(_A, _B)      _stricmp(_A, _B) == 0
-#define CLOVER_strnicmp(_A, _B, _C) _strnicmp(_A, _B, _C) == 0
-#define CLOVER_strlen(_A)           strlen(_A)
-#define CLOVER_strtoul(_A, _B, _C)  strtoul(_A, _B, _C)
-#define CLOVER_fprintf(_A, ...)     fprintf(fp, _A, __VA_ARGS__)
-#endif
+template<>
+struct CommandLineOptionsTraits<wchar_t> {
+    static wchar_t FoldCase(wchar_t c) { return (c >= L'A' && c <= L'Z') ? (wchar_t) (c + (L'a' - L'A')) : c; }
+    static size_t Length(wchar_t const* s);
+    static bool ParseInt64(wchar_t const* s, int64_t* value);
+    static bool ParseUInt64(wchar_t const* s, uint64_t* value);
+    static bool ParseDouble(wchar_t const* s, double* value);
+    static bool ParseBool(wchar_t const* s, bool* value);
+    static wchar_t** GetEnvironment();
+    static int Print(FILE* fp, wchar_t const* s);
+    static int Print(FILE* fp, wchar_t c);
+    static int PrintNarrow(FILE* fp, char const* s);
+};
 
-void CommandLineOptions::AddOption(bool* value, CharT const* name, CharT const* description, bool includeInUsage)
-{
-    options_.emplace_back(Option{ name, nullptr, description, (void*) value, Option::BOOL, includeInUsage, false });
-}
+// Conversions from argument text to the value types of options (see OPTION
+// TYPES above).  Specialise this for other types; Parse() returns false if the
+// text isn't a valid value, and may keep pointers into text, which outlives
+// the options.
+template<typename T, typename CharT, typename Enable=void>
+struct CommandLineValueTraits;
 
-void CommandLineOptions::AddOption(uint32_t* value, CharT const* name, CharT const* valueDesc, CharT const* description, bool includeInUsage)
-{
-    options_.emplace_back(Option{ name, valueDesc, description, (void*) value, Option::UINT32, includeInUsage, false });
-}
+// The few type traits that the declarations need, so that they don't need
+// <type_traits>.
+template<typename T, typename U> struct CommandLineIsSame { static constexpr bool value = false; };
+template<typename T> struct CommandLineIsSame<T, T> { static constexpr bool value = true; };
 
-void CommandLineOptions::AddOption(CharT** value, CharT const* name, CharT const* valueDesc, CharT const* description, bool includeInUsage)
-{
-    options_.emplace_back(Option{ name, valueDesc, description, (void*) value, valueDesc == nullptr ? Option::ARG : Option::STRING, includeInUsage, false });
-}
+template<bool Condition> struct CommandLineEnableIf {};
+template<> struct CommandLineEnableIf<true> { using type = void; };
 
-void CommandLineOptions::AddUsageNewLine()
-{
-    options_.emplace_back(Option{ nullptr, nullptr, nullptr, nullptr, Option::NEWLINE, true, false });
-}
+template<typename T> struct CommandLineIsInteger { static constexpr bool value = false; };
+template<typename T> struct CommandLineIsFloat { static constexpr bool value = false; };
 
-void CommandLineOptions::PrintUsage(FILE* fp, int targetWidth) const
-{
-    // Scan options to determine option width, etc.
-    size_t colWidth = 0;
-    bool hasOptions = false;
-    for (auto const& opt : options_) {
-        if (opt.type_ != Option::NEWLINE && opt.type_ != Option::ARG) {
-            hasOptions = true;
-            colWidth = std::max(colWidth, (opt.name_      == nullptr ? 0 : CLOVER_strlen(opt.name_)) +
-                                          (opt.valueDesc_ == nullptr ? 0 : CLOVER_strlen(opt.valueDesc_) + 1));
+#define CLOVER_TYPE_TRAIT_(Trait, T) template<> struct Trait<T> { static constexpr bool value = true; };
+CLOVER_TYPE_TRAIT_(CommandLineIsInteger, char)
+CLOVER_TYPE_TRAIT_(CommandLineIsInteger, signed char)
+CLOVER_TYPE_TRAIT_(CommandLineIsInteger, unsigned char)
+CLOVER_TYPE_TRAIT_(CommandLineIsInteger, wchar_t)
+CLOVER_TYPE_TRAIT_(CommandLineIsInteger, char16_t)
+CLOVER_TYPE_TRAIT_(CommandLineIsInteger, char32_t)
+#ifdef __cpp_char8_t
+CLOVER_TYPE_TRAIT_(CommandLineIsInteger, char8_t)
+#endif
+CLOVER_TYPE_TRAIT_(CommandLineIsInteger, short)
+CLOVER_TYPE_TRAIT_(CommandLineIsInteger, unsigned short)
+CLOVER_TYPE_TRAIT_(CommandLineIsInteger, int)
+CLOVER_TYPE_TRAIT_(CommandLineIsInteger, unsigned int)
+CLOVER_TYPE_TRAIT_(CommandLineIsInteger, long)
+CLOVER_TYPE_TRAIT_(CommandLineIsInteger, unsigned long)
+CLOVER_TYPE_TRAIT_(CommandLineIsInteger, long long)
+CLOVER_TYPE_TRAIT_(CommandLineIsInteger, unsigned long long)
+CLOVER_TYPE_TRAIT_(CommandLineIsFloat, float)
+CLOVER_TYPE_TRAIT_(CommandLineIsFloat, double)
+CLOVER_TYPE_TRAIT_(CommandLineIsFloat, long double)
+#undef CLOVER_TYPE_TRAIT_
+
+template<typename T, typename CharT>
+struct CommandLineValueTraits<T, CharT, typename CommandLineEnableIf<CommandLineIsInteger<T>::value>::type> {
+    static bool Parse(CharT* text, T* value)
+    {
+        if constexpr ((T) -1 < (T) 0) {
+            int64_t v = 0;
+            if (!CommandLineOptionsTraits<CharT>::ParseInt64(text, &v) || (int64_t) (T) v != v) {
+                return false;
+            }
+            *value = (T) v;
+        } else {
+            uint64_t v = 0;
+            if (!CommandLineOptionsTraits<CharT>::ParseUInt64(text, &v) || (uint64_t) (T) v != v) {
+                return false;
+            }
+            *value = (T) v;
         }
+        return true;
     }
-    colWidth += 8;
+};
 
-    // usage: exe [options] arg arg ...
+template<typename T, typename CharT>
+struct CommandLineValueTraits<T, CharT, typename CommandLineEnableIf<CommandLineIsFloat<T>::value>::type> {
+    static bool Parse(CharT* text, T* value)
     {
-        CharT path[MAX_PATH];
-        #if CLOVER_USE_WCHAR_T
-        GetModuleFileNameW(nullptr, path, MAX_PATH);
-        std::wstring filename(path);
-        #else
-        GetModuleFileNameA(nullptr, path, MAX_PATH);
-        std::string filename(path);
-        #endif
+        double v = 0.0;
+        if (!CommandLineOptionsTraits<CharT>::ParseDouble(text, &v)) {
+            return false;
+        }
+        *value = (T) v;
+        return true;
+    }
+};
 
-        filename.erase(0, filename.find_last_of(CLOVER_MAKESTR("/\\")) + 1);
+template<typename CharT>
+struct CommandLineValueTraits<bool, CharT> {
+    static bool Parse(CharT* text, bool* value) { return CommandLineOptionsTraits<CharT>::ParseBool(text, value); }
+};
 
-        auto n = filename.size();
-        if (n > 4 && CLOVER_stricmp(filename.c_str() + n - 4, CLOVER_MAKESTR(".exe"))) {
-            filename.resize(n - 4);
-        }
+template<typename CharT>
+struct CommandLineValueTraits<CharT*, CharT> {
+    static bool Parse(CharT* text, CharT** value) { *value = text; return true; }
+};
 
-        CLOVER_fprintf("usage: %s", filename.c_str());
-    }
-    if (hasOptions) {
-        CLOVER_fprintf(" [options]");
-    }
-    for (auto const& opt : options_) {
-        if (opt.type_ == Option::ARG) {
-            CLOVER_fprintf(" %s", opt.name_);
-        }
-    }
-    CLOVER_fprintf("\n");
+template<typename CharT>
+struct CommandLineValueTraits<CharT const*, CharT> {
+    static bool Parse(CharT* text, CharT const** value) { *value = text; return true; }
+};
 
-    // options:
-    //     --name=value    desc...
-    if (hasOptions) {
-        CLOVER_fprintf("options:\n");
-        for (auto const& opt : options_) {
-            if (opt.includeInUsage_) {
-                int x = 0;
-                if (opt.name_ != nullptr) {
-                    x += CLOVER_fprintf("    --%s", opt.name_);
-                }
-                if (opt.valueDesc_ != nullptr) {
-                    x += CLOVER_fprintf("=%s", opt.valueDesc_);
-                }
-                if (opt.description_ != nullptr) {
-                    x += CLOVER_fprintf(" ");
-                    for (; x < colWidth; ++x) {
-                        CLOVER_fprintf(" ");
-                    }
-                    for (auto p = opt.description_; *p; ++p) {
-                        if (x > targetWidth && *p == ' ') {
-                            x = (int) colWidth;
-                            CLOVER_fprintf("\n%*s", x, CLOVER_MAKESTR(""));
-                        } else {
-                            x += CLOVER_fprintf("%c", *p);
-                        }
-                    }
-                }
-                CLOVER_fprintf("\n");
-            }
-        }
+#if CLOVER_ENABLE_RUNTIME
+// The value of a live option (see LIVE OPTIONS above), alone on its cache line
+// so that updating it doesn't slow down reads of its neighbours.
+template<typename T>
+struct alignas(64) CommandLineLiveValue {
+    static_assert(CommandLineIsInteger<T>::value || CommandLineIsFloat<T>::value || CommandLineIsSame<T, bool>::value || __is_enum(T),
+                  "live values must be arithmetic or enum types");
+    static_assert(sizeof(T) <= 16, "live values must be at most 16 bytes");
+
+    std::atomic<T> value_;
+
+    CommandLineLiveValue(T value=T()) : value_(value) {}
+
+    T Load() const { return value_.load(std::memory_order_relaxed); }
+};
+#endif
+
+template<typename CharType>
+class CommandLineOptionsT {
+public:
+    using CharT = CharType;
+    using Traits = CommandLineOptionsTraits<CharT>;
+
+    CommandLineOptionsT();
+    CommandLineOptionsT(CommandLineOptionsT&& other);
+    CommandLineOptionsT& operator=(CommandLineOptionsT&& other);
+    ~CommandLineOptionsT();
+
+    CommandLineOptionsT(CommandLineOptionsT const&) = delete;
+    CommandLineOptionsT& operator=(CommandLineOptionsT const&) = delete;
+
+    CommandLineOptionHandle AddOption(bool*   value, CharT const* name,                         CharT const* description, bool includeInUsage=true);
+    CommandLineOptionHandle AddOption(CharT** value, CharT const* name, CharT const* valueDesc, CharT const* description, bool includeInUsage=true);
+
+    // Adds an option of any type with a CommandLineValueTraits
+    // specialisation (see OPTION TYPES above).
+    template<typename T>
+    CommandLineOptionHandle AddOption(T* value, CharT const* name, CharT const* valueDesc, CharT const* description, bool includeInUsage=true)
+    {
+        return AddValueOption((void*) value, name, valueDesc, description, &Convert<T>, &TypeName<T>, ValueSize<T>(), includeInUsage);
     }
-}
 
-CommandLineOptionsResult CommandLineOptions::Parse(int argc, CharT** argv, int* errorArgIndex)
-{
-    int argIndex = 1;
+    // An entry in a static table of options whose values are fields of one
+    // struct, as generated by CLOVER_DECLARE_OPTIONS (see STRUCT BINDING
+    // above).  Make<T>() gives the entry for a field of type T, which is a
+    // flag or a positional argument like AddOption() if valueDesc==nullptr.
+    struct OptionEntry {
+        enum Kind : uint8_t { Value, Flag, Positional, };
 
-    auto Error = [&argIndex, errorArgIndex](CommandLineOptionsResult result) {
-        if (errorArgIndex != nullptr) {
-            *errorArgIndex = argIndex;
+        CharT const* name_;
+        CharT const* valueDesc_;
+        CharT const* description_;
+        size_t offset_;
+        uint32_t size_;
+        bool (*convert_)(void* value, CharT* text);
+        char const* (*typeName_)();
+        Kind kind_;
+
+        template<typename T>
+        static constexpr OptionEntry Make(CharT const* name, CharT const* valueDesc, CharT const* description, size_t offset)
+        {
+            auto kind = valueDesc != nullptr               ? Value :
+                        CommandLineIsSame<T, bool>::value   ? Flag :
+                        CommandLineIsSame<T, CharT*>::value ? Positional : Value;
+            return OptionEntry{ name, valueDesc, description, offset, ValueSize<T>(), &Convert<T>, &TypeName<T>, kind };
         }
-        return result;
     };
 
-    for ( ; argIndex < argc; ++argIndex) {
-        auto arg = argv[argIndex];
+    // Adds the options of a table, storing their values at base+offset_.
+    // The returned handle is that of the first entry; the rest follow it in
+    // order.
+    CommandLineOptionHandle AddOptions(OptionEntry const* table, size_t count, void* base, bool includeInUsage=true);
 
-        bool hasPrefix = true;
-        if (*arg == '/') {
-            ++arg;
+    // Adds the options of a struct declared by CLOVER_DECLARE_OPTIONS.
+    template<typename S>
+    CommandLineOptionHandle AddOptions(S* options, bool includeInUsage=true)
+    {
+        size_t count = 0;
+        auto table = S::GetOptionTable(&count);
+        return AddOptions(table, count, (void*) options, includeInUsage);
+    }
+
+    // A callable invoked by an action option, stored inline (see ACTIONS
+    // above).
+    class Action {
+    public:
+        static constexpr size_t kStorageSize = 4 * sizeof(void*);
+
+        template<typename T, typename F>
+        static Action Make(F const& f)
+        {
+            static_assert(__is_trivially_copyable(F), "actions must be trivially copyable");
+            static_assert(sizeof(F) <= kStorageSize && alignof(F) <= alignof(void*), "action is too large to store inline");
+
+            Action action;
+            memcpy(action.storage_, &f, sizeof(F));
+            action.invoke_ = &Invoke<T, F>;
+            return action;
+        }
+
+        bool operator()(CharT* text) const { return invoke_(storage_, text); }
+
+    private:
+        alignas(void*) unsigned char storage_[kStorageSize];
+        bool (*invoke_)(void const* storage, CharT* text);
+
+        template<typename F, typename... Args>
+        static bool Call(F const& f, Args const&... args)
+        {
+            if constexpr (CommandLineIsSame<decltype(f(args...)), void>::value) {
+                f(args...);
+                return true;
+            } else {
+                return f(args...);
+            }
+        }
+
+        // T is void for flag actions, which are called without a value.
+        template<typename T, typename F>
+        static bool Invoke(void const* storage, CharT* text)
+        {
+            auto const& f = *(F const*) storage;
+            if constexpr (CommandLineIsSame<T, void>::value) {
+                (void) text;
+                return Call(f);
+            } else {
+                T value{};
+                return CommandLineValueTraits<T, CharT>::Parse(text, &value) && Call(f, value);
+            }
+        }
+    };
+
+    template<typename F>
+    CommandLineOptionHandle AddAction(CharT const* name, CharT const* description, F const& action, bool includeInUsage=true)
+    {
+        return AddAction(name, nullptr, description, Action::template Make<void>(action), includeInUsage);
+    }
+
+    template<typename T=CharT*, typename F>
+    CommandLineOptionHandle AddAction(CharT const* name, CharT const* valueDesc, CharT const* description, F const& action, bool includeInUsage=true)
+    {
+        return AddAction(name, valueDesc, description, Action::template Make<T>(action), includeInUsage);
+    }
+
+    CommandLineOptionHandle AddAction(CharT const* name, CharT const* valueDesc, CharT const* description, Action const& action, bool includeInUsage=true);
+
+#if CLOVER_ENABLE_RUNTIME
+    // Adds an option whose value can change while other threads read it (see
+    // LIVE OPTIONS above).
+    template<typename T>
+    CommandLineOptionHandle AddLiveOption(CommandLineLiveValue<T>* value, CharT const* name, CharT const* valueDesc, CharT const* description, bool includeInUsage=true)
+    {
+        return AddLiveValueOption((void*) value, name, valueDesc, description, &Convert<T>, &TypeName<T>, &LoadLive<T>, &StoreLive<T>, sizeof(T), includeInUsage);
+    }
+
+    // Converts text as Parse() would, stores it in a live option, calls the
+    // option's watchers, and republishes the snapshot (see SNAPSHOTS above)
+    // and the shared-memory segment if there are any.  Returns
+    // CommandLineOptions_ErrorUnrecognisedArgument if handle isn't a live
+    // option, and leaves the value unchanged on any error.
+    CommandLineOptionsResult SetLiveValue(CommandLineOptionHandle handle, CharT const* text);
+
+    // Adds a function for SetLiveValue() to call after it changes an option.
+    // Watchers must be added before updates start, and mustn't call
+    // SetLiveValue() themselves.
+    using LiveWatcher = void (*)(CommandLineOptionHandle handle, void* context);
+    void AddWatcher(CommandLineOptionHandle handle, LiveWatcher watcher, void* context=nullptr);
+
+    // An immutable copy of the values of the options and of the set found
+    // by any source, made by PublishSnapshot() (see SNAPSHOTS above).
+    class Snapshot {
+    public:
+        // Returns the value of an option with a value of type T (the T of
+        // a CommandLineLiveValue<T>), or nullptr if handle doesn't refer to
+        // one of that size.
+        template<typename T>
+        T const* Get(CommandLineOptionHandle handle) const
+        {
+            auto i = (uint32_t) handle;
+            if (i >= optionCount_ || layout_[2 * i + 1] != sizeof(T)) {
+                return nullptr;
+            }
+            return (T const*) (values_ + layout_[2 * i]);
+        }
+
+        bool WasFound(CommandLineOptionHandle handle) const
+        {
+            auto i = (uint32_t) handle;
+            return i < optionCount_ && ((found_[i / 64] >> (i % 64)) & 1);
+        }
+
+        // PublishSnapshot() numbers snapshots from 1.
+        uint64_t GetVersion() const { return version_; }
+
+    private:
+        friend class CommandLineOptionsT;
+
+        uint64_t version_;
+        uint32_t optionCount_;
+        uint32_t const* layout_; // the offset and size of each value
+        uint64_t const* found_;
+        unsigned char const* values_;
+    };
+
+    // Gives one thread access to the published snapshots.  Acquire()
+    // returns the latest (or nullptr if there isn't one yet), which stays
+    // valid until Release(); both are wait-free.
+    class SnapshotReader {
+    public:
+        SnapshotReader(SnapshotReader&& other);
+        ~SnapshotReader();
+
+        SnapshotReader(SnapshotReader const&) = delete;
+        SnapshotReader& operator=(SnapshotReader const&) = delete;
+
+        Snapshot const* Acquire();
+        void Release();
+
+    private:
+        friend class CommandLineOptionsT;
+        struct Slot;
+
+        explicit SnapshotReader(Slot* slot) : slot_(slot) {}
+
+        Slot* slot_;
+    };
+
+    SnapshotReader AddSnapshotReader();
+
+    // Copies the current values of the options into a new snapshot, and
+    // publishes it to readers.  The one it replaces is freed once no reader
+    // can be using it.  Returns the new snapshot's version.
+    uint64_t PublishSnapshot();
+
+    // Allows ReloadConfigFile() to change an option.  Returns false if it
+    // isn't a bool or a value option whose type can be copied as bytes.
+    bool SetReloadable(CommandLineOptionHandle handle, bool reloadable=true);
+
+    // Parses a config file as ParseConfigFile() does, but only changes the
+    // reloadable options whose values differ from the current ones (see HOT
+    // RELOAD above).  Nothing changes if the file has an error.
+    CommandLineOptionsResult ReloadConfigFile(char const* path, CommandLineOptionsReload* reload=nullptr);
+
+    // Calls ReloadConfigFile() from a background thread whenever the file is
+    // written or replaced, and then callback with what it did.  Returns false
+    // if the file's directory can't be watched; the reloader uses inotify, so
+    // this is always the case other than on Linux.
+    using ReloadCallback = void (*)(CommandLineOptionsReload const& reload, void* context);
+    bool StartReloader(char const* path, ReloadCallback callback, void* context=nullptr);
+    void StopReloader();
+
+    // Parses a command line that may differ from the last one in only a few
+    // arguments, converting just those (see INCREMENTAL PARSING above).
+    // Copies the handles of up to capacity options whose values changed to
+    // changed, and sets *changedCount to the number of them.  Otherwise the
+    // same as Parse().
+    CommandLineOptionsResult ParseIncremental(int argc, CharT** argv, int* errorArgIndex,
+                                              CommandLineOptionHandle* changed, uint32_t capacity, uint32_t* changedCount);
+
+    // Creates a POSIX shared-memory segment called name (e.g.,
+    // "/server.options") and writes the options and their current values to
+    // it, for CommandLineSharedOptionsT to read from other processes (see
+    // SHARED MEMORY above).  Returns false if the segment can't be created,
+    // which is always the case on Windows, or if another running process
+    // published one called name.  Any other segment called name is
+    // replaced.  The segment is removed when the options are destroyed.
+    bool PublishToSharedMemory(char const* name);
+
+    // Writes the current values to the segment.  Changes made through the
+    // live paths (SetLiveValue(), reloads and ParseIncremental()) do this
+    // themselves; call it after Parse() and the other sources.
+    void UpdateSharedMemory();
+#endif
+
+    void AddUsageNewLine();
+    void AddUsageSection(CharT const* title);
+
+    // Adds a subcommand (see SUBCOMMANDS above).  If Parse() finds name,
+    // factory is called with the subcommand's options and context.
+    using SubcommandFactory = void (*)(CommandLineOptionsT* subcommand, void* context);
+    void AddSubcommand(CharT const* name, CharT const* description, SubcommandFactory factory, void* context=nullptr);
+
+    // After Parse() has been called, returns the subcommand that was found
+    // and its name, or nullptr if there wasn't one.
+    CommandLineOptionsT* GetSubcommand() const;
+    CharT const* GetSubcommandName() const;
+
+    // Sets a single character alias for an option (see above).  Returns
+    // false if c isn't a printable ASCII character other than '-', '=', '?'
+    // or 'h', or is already in use.
+    bool SetShortName(CommandLineOptionHandle handle, CharT c);
+
+    uint32_t GetOptionCount(bool includeNewlines=false) const;
+
+    // Restricts an option's values to one of count strings, which shell
+    // completion offers (see SHELL COMPLETION above).  The strings must
+    // outlive the options.
+    void SetValueChoices(CommandLineOptionHandle handle, CharT const* const* choices, uint32_t count);
+
+    // Prints a script that sets up completion of programName's arguments in
+    // a shell (see SHELL COMPLETION above).
+    void PrintCompletionScript(FILE* fp, CommandLineOptionsShell shell, CharT const* programName) const;
+
+    // Adds constraints between options, which Parse() checks once all the
+    // arguments are parsed (see CONSTRAINTS above).  AddRequires() requires
+    // all of required if option is found, AddConflicts() allows at most one
+    // of options, and AddOneOf() requires exactly one of options.
+    void AddRequires(CommandLineOptionHandle option, CommandLineOptionHandle const* required, uint32_t count);
+    void AddConflicts(CommandLineOptionHandle const* options, uint32_t count);
+    void AddOneOf(CommandLineOptionHandle const* options, uint32_t count);
+
+    // After Parse() has been called, returns the index in argv of the
+    // argument that set an option, or -1 if none did.
+    int GetArgIndex(CommandLineOptionHandle handle) const;
+
+    // Enables optional matching behaviour; a combination of
+    // CommandLineOptionsParseFlags.
+    void SetParseFlags(uint32_t flags);
+
+    // Finds the options whose names are closest to an argument that didn't
+    // match (see SUGGESTIONS above).  Copies the handles of up to capacity of
+    // them to handles, closest first, and returns how many were copied.
+    uint32_t GetSuggestions(CharT const* arg, CommandLineOptionHandle* handles, uint32_t capacity, uint32_t maxDistance=2) const;
+
+    // A name close to an unrecognised argument: an option's, without its
+    // prefix, or a subcommand's.
+    struct Suggestion {
+        CharT const* name_;
+        bool isCommand_;
+    };
+
+    // Like GetSuggestions() above, but also considers the options of the
+    // instances enclosing the subcommand that Parse() chose, which it
+    // accepts too, and the names of its subcommands if arg has no prefix.
+    // PrintError() reports these.
+    uint32_t GetSuggestions(CharT const* arg, Suggestion* suggestions, uint32_t capacity, uint32_t maxDistance=2) const;
+
+    // Prints an error message for a result returned by Parse() and the
+    // argument that caused it, with any suggestions.
+    void PrintError(FILE* fp, CommandLineOptionsResult result, CharT const* arg) const;
+
+    // After Parse() returned CommandLineOptions_ErrorAmbiguousArgument, copies
+    // the handles of up to capacity options that the argument abbreviates to
+    // handles, and returns the number of such options.  These are options of
+    // the instance that the argument was looked up in, which for a subcommand
+    // may be an enclosing one (call this on each to find out).
+    uint32_t GetAmbiguousOptions(CommandLineOptionHandle* handles, uint32_t capacity) const;
+
+    // Print usage (see above). Option descriptions are wrapped at any
+    // whitespace exceeding the line's targetWidth.
+    //
+    // If term!=nullptr, or Parse() found "--help=TERM", only the options
+    // matching it are printed (see Searching usage above).
+    void PrintUsage(FILE* fp=stderr, int targetWidth=100) const;
+    void PrintUsage(FILE* fp, CharT const* term, int targetWidth=100) const;
+
+    // Parses the command line arguments.  Parsing again first undoes the
+    // last command line: options it set get back the values a lower priority
+    // source gave them, or else the ones they had before the first parse
+    // (unless their type can't be copied), and are no longer found by it.
+    //
+    // If errorArgIndex!=nullptr and the returned
+    // result!=CommandLineOptions_Ok, then that result was caused by the
+    // argument at argv[*errorArgIndex].
+    CommandLineOptionsResult Parse(int argc, CharT** argv, int* errorArgIndex);
+
+    // Parses the command line arguments like Parse() above, but carries on
+    // past errors (see COLLECTING ERRORS above).  The first capacity errors
+    // are stored in errors, and *errorCount is set to the number found.
+    // Returns the result of the first error, or CommandLineOptions_Ok.
+    CommandLineOptionsResult Parse(int argc, CharT** argv, CommandLineOptionsError* errors, uint32_t capacity, uint32_t* errorCount);
+
+    // Parses the command line like Parse() above, but reuses the result of
+    // parsing the same arguments before from a file in cacheDir, or writes
+    // one there (see PARSE CACHE above).
+    CommandLineOptionsResult ParseCached(char const* cacheDir, int argc, CharT** argv, int* errorArgIndex);
+
+    // Sets options that haven't been found yet from environment variables
+    // named prefix+NAME (see above).  If envp==nullptr, the process
+    // environment is used.
+    //
+    // If errorVariable!=nullptr and the returned
+    // result!=CommandLineOptions_Ok, then that result was caused by the
+    // environment variable "NAME=VALUE" string *errorVariable.
+    CommandLineOptionsResult ParseEnvironment(CharT const* prefix, CharT** envp=nullptr, CharT const** errorVariable=nullptr);
+
+    // Sets options that haven't been found yet from the config file at path
+    // (see above).
+    //
+    // If errorLine!=nullptr and the returned result!=CommandLineOptions_Ok,
+    // then that result was caused by line *errorLine (starting from 1) of the
+    // file, or the file couldn't be read if *errorLine==0.  In the latter case
+    // the result is CommandLineOptions_ErrorUnrecognisedArgument.
+    CommandLineOptionsResult ParseConfigFile(char const* path, int* errorLine=nullptr);
+
+    // Applies the command line, the environment (if envPrefix!=nullptr) and a
+    // config file (if configPath!=nullptr) in priority order.
+    //
+    // If the returned result!=CommandLineOptions_Ok, then *errorSource is the
+    // source that caused it and *errorIndex is the argv index, the index of
+    // the variable in the process environment, or the config file line, as
+    // reported by Parse(), ParseEnvironment() and ParseConfigFile().  If a
+    // constraint is violated, they're the source of the offending option and
+    // its argv index, or 0 if no command line argument set it.
+    CommandLineOptionsResult Resolve(int argc, CharT** argv, CharT const* envPrefix, char const* configPath,
+                                     CommandLineOptionsSource* errorSource, int* errorIndex);
+
+    // Returns the handle of the option with the given name, or
+    // CommandLineOptionHandle::Invalid.
+    CommandLineOptionHandle FindOption(CharT const* name) const;
+
+    // Returns the highest priority source that set an option's value, or
+    // CommandLineOptions_SourceDefault if none has.
+    CommandLineOptionsSource GetSource(CommandLineOptionHandle handle) const;
+
+    // After Parse() has been called, returns whether a particular option
+    // matched an argument in the command line.
+    bool WasFound(CharT const* name) const;
+    bool WasFound(CommandLineOptionHandle handle) const;
+
+private:
+    // The converter of a typed option, chosen when it's added.
+    using ConvertFn = bool (*)(void* value, CharT* text);
+
+    template<typename T>
+    static bool Convert(void* value, CharT* text) { return CommandLineValueTraits<T, CharT>::Parse(text, (T*) value); }
+
+    // The size of a value that can be copied as bytes, or 0.
+    template<typename T>
+    static constexpr uint32_t ValueSize() { return __is_trivially_copyable(T) ? (uint32_t) sizeof(T) : 0; }
+
+    // The compiler's signature of TypeName<T>(), which names T, so that the
+    // parse cache can tell value types of the same size apart.
+    using TypeNameFn = char const* (*)();
+
+    template<typename T>
+    static char const* TypeName()
+    {
+#ifdef _MSC_VER
+        return __FUNCSIG__;
+#else
+        return __PRETTY_FUNCTION__;
+#endif
+    }
+
+    CommandLineOptionHandle AddValueOption(void* value, CharT const* name, CharT const* valueDesc, CharT const* description, ConvertFn convert, TypeNameFn typeName,
+                                           uint32_t valueSize, bool includeInUsage);
+
+#if CLOVER_ENABLE_RUNTIME
+    // Copies between a live option's value and a plain T, which its
+    // converter writes.
+    using LiveFn = void (*)(void* live, void* plain);
+
+    template<typename T>
+    static void LoadLive(void* live, void* plain) { *(T*) plain = ((CommandLineLiveValue<T>*) live)->value_.load(std::memory_order_relaxed); }
+
+    template<typename T>
+    static void StoreLive(void* live, void* plain) { ((CommandLineLiveValue<T>*) live)->value_.store(*(T*) plain, std::memory_order_release); }
+
+    CommandLineOptionHandle AddLiveValueOption(void* value, CharT const* name, CharT const* valueDesc, CharT const* description, ConvertFn convert,
+                                               TypeNameFn typeName, LiveFn load, LiveFn store, uint32_t valueSize, bool includeInUsage);
+#endif
+
+    // The option storage is only defined in the implementation, so that
+    // including this header doesn't require <vector>.
+    struct Impl;
+    Impl* impl_;
+};
+
+extern template class CommandLineOptionsT<char>;
+extern template class CommandLineOptionsT<wchar_t>;
+
+#if CLOVER_USE_WCHAR_T
+using CommandLineOptions = CommandLineOptionsT<wchar_t>;
+#else
+using CommandLineOptions = CommandLineOptionsT<char>;
+#endif
+
+#if CLOVER_ENABLE_RUNTIME
+// Reads the options that another process published with
+// PublishToSharedMemory() (see SHARED MEMORY above).  Read() copies a
+// consistent version of them, which the other methods then look at; options
+// are identified by their position in the segment, from 0 to
+// GetOptionCount() - 1.
+template<typename CharType>
+class CommandLineSharedOptionsT {
+public:
+    using CharT = CharType;
+
+    CommandLineSharedOptionsT() = default;
+    ~CommandLineSharedOptionsT();
+
+    CommandLineSharedOptionsT(CommandLineSharedOptionsT const&) = delete;
+    CommandLineSharedOptionsT& operator=(CommandLineSharedOptionsT const&) = delete;
+
+    // Returns false if the segment doesn't exist, which is always the case
+    // on Windows.
+    bool Open(char const* name);
+    void Close();
+
+    // Returns false if the segment isn't open, wasn't written by a clover
+    // with the same layout and character type, or is being written
+    // continuously.  The last copy is kept if so.
+    bool Read();
+
+    // The number of times the segment has been written, as of the last
+    // Read().
+    uint64_t GetVersion() const { return version_; }
+
+    uint32_t GetOptionCount() const;
+    CharT const* GetName(uint32_t i) const;
+    CommandLineOptionHandle GetHandle(uint32_t i) const;
+    CommandLineOptionsValueKind GetKind(uint32_t i) const;
+    bool WasFound(uint32_t i) const;
+
+    // Returns the index of the option called name, or UINT32_MAX.
+    uint32_t Find(CharT const* name) const;
+
+    // Returns the value of an option other than a string if it has type T
+    // (e.g., int64_t for a CommandLineOptions_ValueInt of that size), or
+    // nullptr.
+    template<typename T>
+    T const* Get(uint32_t i) const { return (T const*) GetValue(i, sizeof(T)); }
+
+    // Returns a string option's value, or nullptr.
+    CharT const* GetString(uint32_t i) const;
+
+private:
+    friend class CommandLineOptionsT<CharType>;
+
+    // The segment's layout, which PublishToSharedMemory() writes.
+    struct Header;
+    struct Entry;
+
+    Header const* GetHeader() const { return (Header const*) copy_; }
+    Entry const* GetEntry(uint32_t i) const;
+    void const* GetValue(uint32_t i, uint32_t size) const;
+    bool Map();
+
+    int fd_ = -1;
+    unsigned char const* mapping_ = nullptr;
+    size_t mappingSize_ = 0;
+    max_align_t* copy_ = nullptr; // the last version read
+    uint64_t version_ = 0;
+};
+
+extern template class CommandLineSharedOptionsT<char>;
+extern template class CommandLineSharedOptionsT<wchar_t>;
+
+#if CLOVER_USE_WCHAR_T
+using CommandLineSharedOptions = CommandLineSharedOptionsT<wchar_t>;
+#else
+using CommandLineSharedOptions = CommandLineSharedOptionsT<char>;
+#endif
+#endif
+
+// Declares a struct with a field for each entry of LIST, and the table of
+// options that AddOptions() uses to bind them (see STRUCT BINDING above).
+#define CLOVER_DECLARE_OPTIONS(StructName, CharType, LIST) \
+    struct StructName { \
+        LIST(CLOVER_OPTION_FIELD_) \
+        static CommandLineOptionsT<CharType>::OptionEntry const* GetOptionTable(size_t* count) \
+        { \
+            using CloverStruct = StructName; \
+            using CloverEntry = CommandLineOptionsT<CharType>::OptionEntry; \
+            static constexpr CloverEntry kTable[] = { LIST(CLOVER_OPTION_ENTRY_) }; \
+            *count = sizeof(kTable) / sizeof(kTable[0]); \
+            return kTable; \
+        } \
+    }
+
+#define CLOVER_OPTION_FIELD_(type, field, name, defaultValue, valueDesc, description) \
+    type field = defaultValue;
+
+#define CLOVER_OPTION_ENTRY_(type, field, name, defaultValue, valueDesc, description) \
+    CloverEntry::Make<type>(name, valueDesc, description, offsetof(CloverStruct, field)),
+
+#endif // CLOVER_H
+
+// The conversion to std::basic_string_view (see OPTION TYPES above) needs
+// <string_view>, so it is only declared if CLOVER_ENABLE_STRING_VIEW=1, and
+// always for the implementation, which must recognise such options.
+#if (CLOVER_ENABLE_STRING_VIEW || (defined(CLOVER_IMPLEMENTATION) && !defined(CLOVER_IMPLEMENTATION_INCLUDED))) && \
+    !defined(CLOVER_STRING_VIEW_INCLUDED)
+#define CLOVER_STRING_VIEW_INCLUDED
+#include <string_view>
+
+template<typename CharT>
+struct CommandLineValueTraits<std::basic_string_view<CharT>, CharT> {
+    static bool Parse(CharT* text, std::basic_string_view<CharT>* value) { *value = text; return true; }
+};
+#endif
+
+
+#if defined(CLOVER_IMPLEMENTATION) && !defined(CLOVER_IMPLEMENTATION_INCLUDED)
+#define CLOVER_IMPLEMENTATION_INCLUDED
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <wchar.h>
+#include <algorithm>
+#include <deque>
+#include <memory>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#if CLOVER_ENABLE_RUNTIME
+#include <mutex>
+#include <thread>
+#endif
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <signal.h>
+#include <sys/stat.h>
+#include <unistd.h>
+extern "C" char** environ;
+#endif
+
+#if CLOVER_ENABLE_RUNTIME && defined(__linux__)
+#include <poll.h>
+#include <sys/inotify.h>
+#endif
+
+// -----------------------------------------------------------------------------
+// CommandLineOptionsTraits
+
+size_t CommandLineOptionsTraits<char>::Length(char const* s)
+{
+    return strlen(s);
+}
+
+size_t CommandLineOptionsTraits<wchar_t>::Length(wchar_t const* s)
+{
+    return wcslen(s);
+}
+
+// strtoull() and wcstoull() accept a leading '-', and negate the result.
+template<typename CharT>
+static bool IsNegative(CharT const* s)
+{
+    while (*s == ' ' || (*s >= '\t' && *s <= '\r')) {
+        ++s;
+    }
+    return *s == '-';
+}
+
+bool CommandLineOptionsTraits<char>::ParseInt64(char const* s, int64_t* value)
+{
+    char* end = nullptr;
+    errno = 0;
+    auto v = strtoll(s, &end, 0);
+    *value = (int64_t) v;
+    return end != s && *end == '\0' && errno == 0;
+}
+
+bool CommandLineOptionsTraits<wchar_t>::ParseInt64(wchar_t const* s, int64_t* value)
+{
+    wchar_t* end = nullptr;
+    errno = 0;
+    auto v = wcstoll(s, &end, 0);
+    *value = (int64_t) v;
+    return end != s && *end == L'\0' && errno == 0;
+}
+
+bool CommandLineOptionsTraits<char>::ParseUInt64(char const* s, uint64_t* value)
+{
+    char* end = nullptr;
+    errno = 0;
+    auto v = strtoull(s, &end, 0);
+    *value = (uint64_t) v;
+    return end != s && *end == '\0' && errno == 0 && !IsNegative(s);
+}
+
+bool CommandLineOptionsTraits<wchar_t>::ParseUInt64(wchar_t const* s, uint64_t* value)
+{
+    wchar_t* end = nullptr;
+    errno = 0;
+    auto v = wcstoull(s, &end, 0);
+    *value = (uint64_t) v;
+    return end != s && *end == L'\0' && errno == 0 && !IsNegative(s);
+}
+
+bool CommandLineOptionsTraits<char>::ParseDouble(char const* s, double* value)
+{
+    char* end = nullptr;
+    errno = 0;
+    *value = strtod(s, &end);
+    return end != s && *end == '\0' && errno == 0;
+}
+
+bool CommandLineOptionsTraits<wchar_t>::ParseDouble(wchar_t const* s, double* value)
+{
+    wchar_t* end = nullptr;
+    errno = 0;
+    *value = wcstod(s, &end);
+    return end != s && *end == L'\0' && errno == 0;
+}
+
+// Shared by both ParseBool()s.
+template<typename CharT>
+static bool ParseBoolText(CharT const* s, bool* value)
+{
+    static char const* const kWords[] = { "1", "true", "yes", "on", "0", "false", "no", "off" };
+    for (size_t i = 0; i < sizeof(kWords) / sizeof(kWords[0]); ++i) {
+        auto a = s;
+        auto b = kWords[i];
+        while (*b != '\0' && CommandLineOptionsTraits<CharT>::FoldCase(*a) == (CharT) *b) {
+            ++a;
+            ++b;
+        }
+        if (*a == '\0' && *b == '\0') {
+            *value = i < 4;
+            return true;
+        }
+    }
+    return false;
+}
+
+bool CommandLineOptionsTraits<char>::ParseBool(char const* s, bool* value)
+{
+    return ParseBoolText(s, value);
+}
+
+bool CommandLineOptionsTraits<wchar_t>::ParseBool(wchar_t const* s, bool* value)
+{
+    return ParseBoolText(s, value);
+}
+
+char** CommandLineOptionsTraits<char>::GetEnvironment()
+{
+    #ifdef _WIN32
+    return _environ;
+    #else
+    return environ;
+    #endif
+}
+
+wchar_t** CommandLineOptionsTraits<wchar_t>::GetEnvironment()
+{
+    #ifdef _WIN32
+    return _wenviron;
+    #else
+    return nullptr;
+    #endif
+}
+
+int CommandLineOptionsTraits<char>::Print(FILE* fp, char const* s)
+{
+    return fprintf(fp, "%s", s);
+}
+
+int CommandLineOptionsTraits<wchar_t>::Print(FILE* fp, wchar_t const* s)
+{
+    return fwprintf(fp, L"%ls", s);
+}
+
+int CommandLineOptionsTraits<char>::Print(FILE* fp, char c)
+{
+    return fputc(c, fp) == EOF ? 0 : 1;
+}
+
+int CommandLineOptionsTraits<wchar_t>::Print(FILE* fp, wchar_t c)
+{
+    return fputwc(c, fp) == WEOF ? 0 : 1;
+}
+
+int CommandLineOptionsTraits<char>::PrintNarrow(FILE* fp, char const* s)
+{
+    return fprintf(fp, "%s", s);
+}
+
+int CommandLineOptionsTraits<wchar_t>::PrintNarrow(FILE* fp, char const* s)
+{
+    #ifdef _MSC_VER
+    return fwprintf(fp, L"%hs", s);
+    #else
+    return fwprintf(fp, L"%s", s);
+    #endif
+}
+
+// -----------------------------------------------------------------------------
+// CommandLineOptionsT
+
+#if CLOVER_ENABLE_RUNTIME
+// The epoch a SnapshotReader announces while it holds a snapshot, or 0, on a
+// cache line of its own.
+template<typename CharType>
+struct CommandLineOptionsT<CharType>::SnapshotReader::Slot {
+    alignas(64) std::atomic<uint64_t> epoch_{ 0 };
+    Impl* impl_ = nullptr;
+    bool used_ = false;
+};
+#endif
+
+template<typename CharType>
+struct CommandLineOptionsT<CharType>::Impl {
+    struct Option {
+        CharT const* name_;
+        CharT const* valueDesc_;
+        CharT const* description_;
+        void* value_;
+        ConvertFn convert_; // VALUE options only
+        enum { NEWLINE, SECTION, ARG, BOOL, VALUE, ACTION, } type_;
+        bool includeInUsage_;
+        uint32_t nameLength_;
+        CharT shortName_ = 0;
+        CharT const* const* choices_ = nullptr;
+        uint32_t choiceCount_ = 0;
+        uint32_t valueSize_ = 0; // BOOL, ARG and VALUE options only
+        TypeNameFn typeName_ = nullptr; // VALUE options only
+#if CLOVER_ENABLE_RUNTIME
+        LiveFn loadLive_ = nullptr; // live options only
+        LiveFn storeLive_ = nullptr;
+        bool reloadable_ = false;
+#endif
+    };
+
+    std::vector<Option> options_;
+    CharT const* programName_ = nullptr;
+
+    // The actions of ACTION options, which point at them through value_.
+    std::deque<Action> actions_;
+
+    struct Subcommand {
+        CharT const* name_;
+        CharT const* description_;
+        SubcommandFactory factory_;
+        void* context_;
+    };
+    std::vector<Subcommand> subcommands_;
+
+#if CLOVER_ENABLE_RUNTIME
+    // The watchers of live options, and the lock that serialises updates to
+    // them (readers don't take it).
+    struct Watcher {
+        uint32_t option_;
+        LiveWatcher watcher_;
+        void* context_;
+    };
+    std::vector<Watcher> watchers_;
+    std::mutex liveMutex_;
+
+    // The published snapshot, and the replaced ones that may still be in
+    // use.  A reader announces the epoch it started in through its slot, and
+    // a snapshot retired in epoch e is freed once no reader announces e or
+    // earlier (see PublishSnapshot()).  readerMutex_ guards the slots' used_.
+    std::atomic<Snapshot*> snapshot_{ nullptr };
+    std::atomic<uint64_t> epoch_{ 1 };
+    uint64_t snapshotVersion_ = 0;
+    struct Retired {
+        Snapshot* snapshot_;
+        uint64_t epoch_;
+    };
+    std::vector<Retired> retired_;
+
+    // Copies of the string values that reloads set, by option, and the ones
+    // they replaced, which are freed with the snapshots of their epoch.
+    struct RetiredString {
+        std::unique_ptr<CharT[]> string_;
+        uint64_t epoch_;
+    };
+    std::vector<std::unique_ptr<CharT[]>> reloadStrings_;
+    std::vector<RetiredString> retiredStrings_;
+    std::deque<typename SnapshotReader::Slot> readerSlots_;
+    std::mutex readerMutex_;
+
+    // The reloader thread, the pipe that stops it, and the results of the
+    // last reload.
+    std::thread reloader_;
+    int reloaderPipe_[2] = { -1, -1 };
+    std::string reloadPath_;
+    std::vector<CommandLineOptionHandle> reloadChanged_;
+    std::vector<CommandLineOptionHandle> reloadRejected_;
+
+    uint64_t Publish();
+    void ReclaimSnapshots();
+    void FreeSnapshots();
+
+    static bool ConvertValue(Option const& opt, CharT* value, void* copy);
+    static bool IsSameValue(Option const& opt, void const* value);
+    CommandLineOptionsResult Reload(char const* path, CommandLineOptionsReload* reload);
+    void RunReloader(int inotifyFd, std::string name, ReloadCallback callback, void* context);
+    void StopReloader();
+    void NotifyChanged(std::vector<CommandLineOptionHandle> const& changed);
+
+    // The arguments of the last ParseIncremental(), by hash, with the option
+    // each one set and the offset of its value in it (0 for a flag).
+    // reparsable_ is false if any of them did anything else.
+    struct ParsedArg {
+        uint64_t hash_;
+        uint32_t option_;
+        uint32_t valueOffset_;
+    };
+    std::vector<ParsedArg> parsedArgs_;
+    bool reparsable_ = false;
+    std::vector<CommandLineOptionHandle> parseChanged_;
+
+    static uint64_t HashArgument(CharT const* arg);
+    bool MatchArgument(CharT* arg, ParsedArg* parsed);
+    CommandLineOptionsResult ParseIncremental(int argc, CharT** argv, int* errorArgIndex);
+    CommandLineOptionsResult Reparse(int argc, CharT** argv, int* errorArgIndex, std::vector<ParsedArg>& args, std::vector<bool> const& matched);
+
+    // The shared-memory segment that PublishToSharedMemory() created, and
+    // its mapping.
+    using SharedOptions = CommandLineSharedOptionsT<CharType>;
+    std::string sharedName_;
+    int sharedFd_ = -1;
+    unsigned char* shared_ = nullptr;
+    size_t sharedSize_ = 0;
+
+    template<typename... T>
+    static bool ConvertsTo(Option const& opt) { return ((opt.convert_ == &Convert<T>) || ...); }
+    static CommandLineOptionsValueKind GetValueKind(Option const& opt);
+    void UpdateShared();
+    void CloseShared();
+    static bool IsStaleShared(char const* name);
+#endif
+
+    // The subcommand found by Parse().  Within that subcommand's Impl,
+    // parent_ and subcommandName_ identify the enclosing options.
+    std::unique_ptr<CommandLineOptionsT> subcommand_;
+    Impl* parent_ = nullptr;
+    CharT const* subcommandName_ = nullptr;
+
+    // Config files mapped by ParseConfigFile(), and copies of any values that
+    // couldn't be terminated in place.  Option values point into these.
+    struct Mapping {
+        void* address_;
+        size_t size_;
+    };
+    std::vector<Mapping> mappings_;
+    std::vector<std::unique_ptr<CharT[]>> ownedStrings_;
+
+    ~Impl()
+    {
+        // The reloader compares values that may point into the mappings, so
+        // it stops first.
+#if CLOVER_ENABLE_RUNTIME
+        StopReloader();
+#endif
+        for (auto const& m : mappings_) {
+            UnmapFile(m);
+        }
+#if CLOVER_ENABLE_RUNTIME
+        FreeSnapshots();
+        CloseShared();
+#endif
+    }
+
+    // The option index: an open-addressed hash table over option names, with
+    // each slot holding an index into options_ plus one (zero is empty).  It
+    // is rebuilt on first use after options are added.
+    std::vector<uint32_t> index_;
+    bool indexDirty_ = true;
+
+    // The options with short names, indexed by the (ASCII) character and
+    // holding an index into options_ plus one.
+    uint32_t shortIndex_[128] = {};
+    bool hasShortNames_ = false;
+
+    uint32_t parseFlags_ = 0;
+
+    // The named options' indices, sorted by folded name, so that the options
+    // an abbreviation matches are adjacent.  Built on first use after options
+    // are added, if abbreviations are enabled.  ambiguous_ holds the options
+    // matched by the last ambiguous abbreviation.
+    std::vector<uint32_t> sorted_;
+    bool sortedDirty_ = true;
+    std::vector<uint32_t> ambiguous_;
+
+    // The term of a "--help=TERM" argument found by Parse().
+    CharT const* helpTerm_ = nullptr;
+
+    // An inverted index over the words of the options' names, descriptions
+    // and section titles, sorted by folded word.  Built on the first search
+    // after options are added.
+    struct HelpWord {
+        CharT const* word_;
+        uint32_t length_;
+        uint32_t option_;
+    };
+    std::vector<HelpWord> helpIndex_;
+    bool helpIndexDirty_ = true;
+
+    // For each source, a bitset over options_ of the options it has set.
+    // blocked_ is the union of the sets of the sources above the one being
+    // applied (see BeginSource()).
+    std::vector<uint64_t> setBits_[CommandLineOptions_SourceCount];
+    std::vector<uint64_t> blocked_;
+
+    // The argv index of the argument that set each option, or -1.
+    std::vector<int> argIndices_;
+
+    // The value each option has below the command line, at
+    // defaultOffsets_[i] in defaults_: the one a lower priority source set,
+    // or else the one it had before the first parse after it was added.  A
+    // later command line that no longer sets the option restores it (see
+    // RecordDefaults()).
+    std::vector<max_align_t> defaults_;
+    std::vector<uint32_t> defaultOffsets_;
+    uint32_t defaultsSize_ = 0;
+
+    // Constraints between options (see CONSTRAINTS above), each with a
+    // bitset over options_ at constraintBits_[begin_, begin_ + words_).
+    // violated_ holds the constraints the last check found violated.
+    struct Constraint {
+        enum { REQUIRES, CONFLICTS, ONE_OF, } type_;
+        uint32_t option_;
+        uint32_t begin_;
+        uint32_t words_;
+    };
+    std::vector<Constraint> constraints_;
+    std::vector<uint64_t> constraintBits_;
+    std::vector<uint32_t> violated_;
+    bool deferConstraints_ = false;
+
+    CommandLineOptionHandle AddOption(CharT const* name, CharT const* valueDesc, CharT const* description, void* value, decltype(Option::type_) type, bool includeInUsage,
+                                      ConvertFn convert=nullptr, uint32_t valueSize=0)
+    {
+        auto index = (uint32_t) options_.size();
+        auto nameLength = name == nullptr ? 0 : (uint32_t) Traits::Length(name);
+        options_.emplace_back(Option{ name, valueDesc, description, value, convert, type, includeInUsage, nameLength });
+        options_.back().valueSize_ = type == Option::BOOL ? (uint32_t) sizeof(bool) :
+                                     type == Option::ARG  ? (uint32_t) sizeof(CharT*) : valueSize;
+        indexDirty_ = true;
+        sortedDirty_ = true;
+        helpIndexDirty_ = true;
+
+        auto wordCount = (options_.size() + 63) / 64;
+        for (auto& bits : setBits_) {
+            bits.resize(wordCount, 0);
+        }
+        argIndices_.emplace_back(-1);
+        return (CommandLineOptionHandle) index;
+    }
+
+    uint32_t GetIndex(Option const* opt) const { return (uint32_t) (opt - options_.data()); }
+
+    static bool TestBit(std::vector<uint64_t> const& bits, uint32_t i) { return (bits[i / 64] >> (i % 64)) & 1; }
+
+    // Prepares to apply values from source.  Afterwards, IsBlocked() reports
+    // whether a higher priority source has set an option.
+    void BeginSource(CommandLineOptionsSource source)
+    {
+        blocked_.assign(setBits_[0].size(), 0);
+        for (int s = source + 1; s < CommandLineOptions_SourceCount; ++s) {
+            for (size_t w = 0, n = blocked_.size(); w < n; ++w) {
+                blocked_[w] |= setBits_[s][w];
+            }
+        }
+    }
+
+    bool IsBlocked(Option const* opt) const { return TestBit(blocked_, GetIndex(opt)); }
+
+    void MarkSet(CommandLineOptionsSource source, Option const* opt)
+    {
+        auto i = GetIndex(opt);
+        setBits_[source][i / 64] |= 1ull << (i % 64);
+    }
+
+    // Marks an option set by the command line argument argv[argIndex].
+    void MarkFound(Option const* opt, int argIndex)
+    {
+        MarkSet(CommandLineOptions_SourceCommandLine, opt);
+        argIndices_[GetIndex(opt)] = argIndex;
+    }
+
+    // Returns word w of the union of every source's set.
+    uint64_t GetFoundBits(size_t w) const
+    {
+        uint64_t found = 0;
+        for (auto const& bits : setBits_) {
+            found |= bits[w];
+        }
+        return found;
+    }
+
+    CommandLineOptionsSource GetSource(uint32_t i) const
+    {
+        for (int s = CommandLineOptions_SourceCount - 1; s > CommandLineOptions_SourceDefault; --s) {
+            if (TestBit(setBits_[s], i)) {
+                return (CommandLineOptionsSource) s;
+            }
+        }
+        return CommandLineOptions_SourceDefault;
+    }
+
+    bool IsSetBelowCommandLine(uint32_t i) const
+    {
+        for (int s = 0; s < CommandLineOptions_SourceCommandLine; ++s) {
+            if (TestBit(setBits_[s], i)) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // Names are hashed with a looser folding than Parse() matches with, so
+    // that the environment's "_" separators can be looked up in the same
+    // index.
+    static CharT IndexFold(CharT c)
+    {
+        c = Traits::FoldCase(c);
+        return (c == '-' || c == '.') ? (CharT) '_' : c;
+    }
+
+    static uint32_t HashName(CharT const* name, size_t n)
+    {
+        uint32_t h = 2166136261u;
+        for (size_t i = 0; i < n; ++i) {
+            h = (h ^ (uint32_t) IndexFold(name[i])) * 16777619u;
+        }
+        return h;
+    }
+
+    static bool NameEquals(Option const& opt, CharT const* name, size_t n, bool loose)
+    {
+        if (opt.nameLength_ != n) {
+            return false;
+        }
+        for (size_t i = 0; i < n; ++i) {
+            if (loose ? IndexFold(opt.name_[i]) != IndexFold(name[i])
+                      : Traits::FoldCase(opt.name_[i]) != Traits::FoldCase(name[i])) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    void BuildIndex()
+    {
+        if (!indexDirty_) {
+            return;
+        }
+        indexDirty_ = false;
+
+        size_t capacity = 8;
+        while (capacity < options_.size() * 2) {
+            capacity *= 2;
+        }
+        index_.assign(capacity, 0);
+
+        auto mask = (uint32_t) capacity - 1;
+        for (uint32_t i = 0, n = (uint32_t) options_.size(); i < n; ++i) {
+            auto const& opt = options_[i];
+            if (opt.name_ == nullptr) {
+                continue;
+            }
+            // The first option added with a given name takes precedence.
+            for (auto slot = HashName(opt.name_, opt.nameLength_) & mask; ; slot = (slot + 1) & mask) {
+                if (index_[slot] == 0) {
+                    index_[slot] = i + 1;
+                    break;
+                }
+                if (NameEquals(options_[index_[slot] - 1], opt.name_, opt.nameLength_, false)) {
+                    break;
+                }
+            }
+        }
+    }
+
+    // Looks up the n characters of name in the index.  If loose, names are
+    // compared with IndexFold() rather than FoldCase().
+    Option* FindOption(CharT const* name, size_t n, bool loose)
+    {
+        BuildIndex();
+        auto mask = (uint32_t) index_.size() - 1;
+        for (auto slot = HashName(name, n) & mask; index_[slot] != 0; slot = (slot + 1) & mask) {
+            auto& opt = options_[index_[slot] - 1];
+            if (NameEquals(opt, name, n, loose)) {
+                return &opt;
+            }
+        }
+        return nullptr;
+    }
+
+    // Flags are options that don't take a value on the command line: bool
+    // options and actions without a valueDesc.
+    static bool IsFlag(Option const& opt)
+    {
+        return opt.type_ == Option::BOOL || (opt.type_ == Option::ACTION && opt.valueDesc_ == nullptr);
+    }
+
+    // Sets a flag that was given without a value.
+    static CommandLineOptionsResult SetFlag(Option* opt)
+    {
+        if (opt->type_ == Option::ACTION) {
+            if (!(*(Action const*) opt->value_)(nullptr)) {
+                return CommandLineOptions_ErrorArgumentValueInvalid;
+            }
+        } else {
+            *((bool*) opt->value_) = true;
+        }
+        return CommandLineOptions_Ok;
+    }
+
+    // Converts and stores a value for a named option.  Parse() only uses
+    // this for options that aren't flags, since flags don't take a value
+    // there.
+    static CommandLineOptionsResult SetValue(Option* opt, CharT* value)
+    {
+        if (opt->choices_ != nullptr && !IsFlag(*opt) &&
+            std::none_of(opt->choices_, opt->choices_ + opt->choiceCount_, [value](CharT const* c) { return EqualIgnoreCase(value, c); })) {
+            return CommandLineOptions_ErrorArgumentValueInvalid;
+        }
+        if (IsFlag(*opt)) {
+            bool b = false;
+            if (!Traits::ParseBool(value, &b)) {
+                return CommandLineOptions_ErrorArgumentValueInvalid;
+            }
+            if (opt->type_ == Option::BOOL) {
+                *((bool*) opt->value_) = b;
+            } else if (b) {
+                return SetFlag(opt);
+            }
+        } else if (opt->type_ == Option::ACTION) {
+            if (!(*(Action const*) opt->value_)(value)) {
+                return CommandLineOptions_ErrorArgumentValueInvalid;
+            }
+        } else if (opt->type_ == Option::VALUE) {
+#if CLOVER_ENABLE_RUNTIME
+            if (opt->storeLive_ != nullptr) {
+                // Convert first, so that an invalid value isn't stored.
+                alignas(16) unsigned char v[16];
+                if (!opt->convert_(v, value)) {
+                    return CommandLineOptions_ErrorArgumentValueInvalid;
+                }
+                opt->storeLive_(opt->value_, v);
+                return CommandLineOptions_Ok;
+            }
+#endif
+            if (!opt->convert_(opt->value_, value)) {
+                return CommandLineOptions_ErrorArgumentValueInvalid;
+            }
+        } else {
+            *((CharT**) opt->value_) = value;
+        }
+        return CommandLineOptions_Ok;
+    }
+
+    // Case-insensitive comparisons of option names.  The second argument may
+    // be a different character type (e.g., a narrow literal).
+    template<typename C>
+    static bool EqualIgnoreCase(CharT const* a, C const* b)
+    {
+        for (; Traits::FoldCase(*a) == Traits::FoldCase((CharT) *b); ++a, ++b) {
+            if (*a == '\0') {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // The edit distances from the name in an unrecognised argument to option
+    // and subcommand names (see SUGGESTIONS above).
+    class NameDistance {
+    public:
+        // Strips the prefix and any value, as Parse() does.  Returns false
+        // if the name is empty or too long to compare.
+        bool Init(CharT const* arg)
+        {
+            if (*arg == '/') {
+                ++arg;
+            } else if (*arg == '-') {
+                ++arg;
+                if (*arg == '-') {
+                    ++arg;
+                }
+            }
+            length_ = 0;
+            while (arg[length_] != '\0' && arg[length_] != '=') {
+                ++length_;
+            }
+            if (length_ == 0 || length_ > 64) {
+                return false;
+            }
+
+            // The positions of each character in the name.  Characters
+            // outside ASCII are rare enough to look up linearly.
+            memset(peq_, 0, sizeof(peq_));
+            for (uint32_t i = 0; i < length_; ++i) {
+                auto c = Traits::FoldCase(arg[i]);
+                if ((uint32_t) c < 128) {
+                    peq_[(uint32_t) c] |= 1ull << i;
+                } else {
+                    auto it = std::find_if(peqOther_.begin(), peqOther_.end(), [c](std::pair<CharT, uint64_t> const& e) { return e.first == c; });
+                    if (it == peqOther_.end()) {
+                        peqOther_.emplace_back(c, 1ull << i);
+                    } else {
+                        it->second |= 1ull << i;
+                    }
+                }
+            }
+            return true;
+        }
+
+        // Returns the distance to name, or a larger one than cutoff once it
+        // can't be within it.
+        uint32_t Measure(CharT const* name, uint32_t nameLength, uint32_t cutoff) const
+        {
+            if ((nameLength > length_ ? nameLength - length_ : length_ - nameLength) > cutoff) {
+                return cutoff + 1;
+            }
+
+            // Hyyro's formulation of Myers' algorithm, for the distance
+            // between the whole argument and name.  score is the distance
+            // between the argument and the name's first j+1 characters, and
+            // each remaining character can reduce it by at most one.
+            auto highBit = 1ull << (length_ - 1);
+            uint64_t pv = ~0ull;
+            uint64_t mv = 0;
+            auto score = length_;
+            for (uint32_t j = 0; j < nameLength; ++j) {
+                auto eq = GetPeq(name[j]);
+                auto xv = eq | mv;
+                auto xh = (((eq & pv) + pv) ^ pv) | eq;
+                auto ph = mv | ~(xh | pv);
+                auto mh = pv & xh;
+                if (ph & highBit) {
+                    ++score;
+                } else if (mh & highBit) {
+                    --score;
+                }
+                ph = (ph << 1) | 1;
+                mh <<= 1;
+                pv = mh | ~(xv | ph);
+                mv = ph & xv;
+                if (score > cutoff + (nameLength - j - 1)) {
+                    return cutoff + 1;
+                }
+            }
+            return score;
+        }
+
+    private:
+        uint64_t peq_[128];
+        std::vector<std::pair<CharT, uint64_t>> peqOther_;
+        uint32_t length_ = 0;
+
+        uint64_t GetPeq(CharT c) const
+        {
+            c = Traits::FoldCase(c);
+            if ((uint32_t) c < 128) {
+                return peq_[(uint32_t) c];
+            }
+            for (auto const& e : peqOther_) {
+                if (e.first == c) {
+                    return e.second;
+                }
+            }
+            return 0;
+        }
+    };
+
+    // Keeps the capacity closest candidates, sorted by distance.  Once there
+    // are capacity of them, a candidate must beat the last.
+    template<typename T>
+    struct Closest {
+        T* items_;
+        uint32_t capacity_;
+        uint32_t maxDistance_;
+        uint32_t count_ = 0;
+        std::vector<uint32_t> distances_;
+
+        Closest(T* items, uint32_t capacity, uint32_t maxDistance) : items_(items), capacity_(capacity), maxDistance_(maxDistance), distances_(capacity) {}
+
+        bool IsFull() const { return count_ == capacity_ && distances_[count_ - 1] == 0; }
+        uint32_t GetCutoff() const { return count_ == capacity_ ? distances_[count_ - 1] - 1 : maxDistance_; }
+
+        void Add(T const& item, uint32_t distance)
+        {
+            auto k = count_ < capacity_ ? count_++ : count_ - 1;
+            for (; k > 0 && distances_[k - 1] > distance; --k) {
+                distances_[k] = distances_[k - 1];
+                items_[k] = items_[k - 1];
+            }
+            distances_[k] = distance;
+            items_[k] = item;
+        }
+    };
+
+    // Looks up an argument's option, falling back on the enclosing
+    // options' when parsing a subcommand.
+    Option* FindOptionInScope(CharT const* name, size_t n, Impl** owner)
+    {
+        for (auto impl = this; impl != nullptr; impl = impl->parent_) {
+            auto opt = impl->FindOption(name, n, false);
+            if (opt != nullptr && opt->type_ != Option::ARG) {
+                *owner = impl;
+                return opt;
+            }
+        }
+        return nullptr;
+    }
+
+    Option* FindShortOptionInScope(CharT c, Impl** owner)
+    {
+        if ((uint32_t) c >= 128) {
+            return nullptr;
+        }
+        for (auto impl = this; impl != nullptr; impl = impl->parent_) {
+            if (auto i = impl->shortIndex_[(uint32_t) c]) {
+                *owner = impl;
+                return &impl->options_[i - 1];
+            }
+        }
+        return nullptr;
+    }
+
+    // Compares the first n characters of a folded name with an option's,
+    // where a shorter name orders first.
+    static int ComparePrefix(Option const& opt, CharT const* name, size_t n)
+    {
+        for (size_t i = 0; i < n; ++i) {
+            if (i == opt.nameLength_) {
+                return -1;
+            }
+            auto a = Traits::FoldCase(opt.name_[i]);
+            auto b = Traits::FoldCase(name[i]);
+            if (a != b) {
+                return a < b ? -1 : 1;
+            }
+        }
+        return 0;
+    }
+
+    void BuildSorted()
+    {
+        if (!sortedDirty_) {
+            return;
+        }
+        sortedDirty_ = false;
+
+        sorted_.clear();
+        for (uint32_t i = 0, n = (uint32_t) options_.size(); i < n; ++i) {
+            if (options_[i].name_ != nullptr && options_[i].type_ != Option::ARG) {
+                sorted_.emplace_back(i);
+            }
+        }
+        std::stable_sort(sorted_.begin(), sorted_.end(), [this](uint32_t a, uint32_t b) {
+            auto const& optB = options_[b];
+            return ComparePrefix(options_[a], optB.name_, optB.nameLength_) < 0;
+        });
+    }
+
+    // Looks up an option that name abbreviates, falling back on the enclosing
+    // options' like FindOptionInScope().  If there are several, returns
+    // nullptr with *ambiguous set, and the owner's ambiguous_ holds them.
+    Option* FindAbbreviationInScope(CharT const* name, size_t n, Impl** owner, bool* ambiguous)
+    {
+        *ambiguous = false;
+        for (auto impl = this; impl != nullptr; impl = impl->parent_) {
+            if ((impl->parseFlags_ & CommandLineOptions_ParseAbbreviations) == 0) {
+                continue;
+            }
+            impl->BuildSorted();
+
+            auto const& options = impl->options_;
+            auto first = std::lower_bound(impl->sorted_.begin(), impl->sorted_.end(), 0u, [&](uint32_t i, uint32_t) {
+                return ComparePrefix(options[i], name, n) < 0;
+            });
+            auto last = std::upper_bound(first, impl->sorted_.end(), 0u, [&](uint32_t, uint32_t i) {
+                return ComparePrefix(options[i], name, n) > 0;
+            });
+            if (last - first == 1) {
+                *owner = impl;
+                return &impl->options_[*first];
+            }
+            if (last - first > 1) {
+                impl->ambiguous_.assign(first, last);
+                *ambiguous = true;
+                return nullptr;
+            }
+        }
+        return nullptr;
+    }
+
+    // Where ParseArguments() reports errors.  result_ is the first error (or
+    // CommandLineOptions_HelpRequested), and argIndex_ its argument.  If
+    // errors_!=nullptr, parsing carries on past errors, and they're stored
+    // there until capacity_ is reached.
+    struct ErrorSink {
+        int* argIndex_;
+        CommandLineOptionsError* errors_;
+        uint32_t capacity_;
+        uint32_t count_;
+        CommandLineOptionsResult result_;
+
+        // Reports an error caused by argv[argIndex], and returns whether to
+        // stop parsing.
+        bool Report(CommandLineOptionsResult result, int argIndex, CommandLineOptionHandle option)
+        {
+            if (result_ == CommandLineOptions_Ok || result == CommandLineOptions_HelpRequested) {
+                result_ = result;
+                if (argIndex_ != nullptr) {
+                    *argIndex_ = argIndex;
+                }
+            }
+            if (errors_ == nullptr || result == CommandLineOptions_HelpRequested) {
+                return true;
+            }
+            if (count_ < capacity_) {
+                errors_[count_] = CommandLineOptionsError{ argIndex, result, option };
+            }
+            count_ += 1;
+            return false;
+        }
+    };
+
+    void BeginParse(int argc, CharT** argv);
+    void ResetResults(int argc, CharT** argv);
+    void RecordDefaults();
+    void ResetCommandLine();
+    CommandLineOptionsResult Parse(int argc, CharT** argv, int* errorArgIndex);
+    CommandLineOptionsResult ParseArguments(int argc, CharT** argv, int argIndex, ErrorSink* sink);
+    CommandLineOptionsResult ParseShortOptions(CharT* arg, int argc, CharT** argv, int* argIndex, CommandLineOptionHandle* failed);
+
+    void AddConstraint(decltype(Constraint::type_) type, uint32_t option, CommandLineOptionHandle const* handles, uint32_t count);
+    void CheckConstraints(ErrorSink* sink, CommandLineOptionsSource* source);
+    void PrintConstraint(FILE* fp, Constraint const& constraint) const;
+
+    void Complete(FILE* fp, CharT** words, int count, int index);
+    void CompleteNames(FILE* fp, CharT const* prefix, size_t n);
+    static void CompleteValues(FILE* fp, Option const& opt, CharT const* before, CharT const* prefix);
+    static void CompleteFiles(FILE* fp, CharT const* before, CharT const* prefix);
+
+    void PrintProgramName(FILE* fp) const;
+    size_t GetColumnWidth() const;
+    void PrintOptions(FILE* fp, size_t colWidth, int targetWidth, std::vector<uint64_t> const* filter) const;
+
+    static bool IsWordChar(CharT c) { return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || (uint32_t) c >= 128; }
+    static int CompareWords(CharT const* a, size_t an, CharT const* b, size_t bn);
+    void BuildHelpIndex();
+    std::vector<uint64_t> Search(CharT const* term);
+    static void PrintDescription(FILE* fp, int x, size_t colWidth, int targetWidth, CharT const* description);
+
+    static bool MapFile(char const* path, Mapping* mapping);
+    static void UnmapFile(Mapping const& mapping);
+
+    static uint32_t AlignValue(uint32_t offset, uint32_t size);
+    uint32_t LayoutValues(std::vector<uint32_t>* layout) const;
+    static void LoadValue(Option const& opt, void* copy);
+    static void StoreValue(Option const& opt, void const* value);
+
+    // The parse cache's files (see PARSE CACHE above) hold a header, the
+    // text of the arguments, the argv index that set each option, the set of
+    // options found, and then the found options' values in order, each
+    // aligned as LayoutValues() does.  A string value is stored as a
+    // CachedString.
+    struct CacheHeader {
+        static constexpr uint32_t kMagic = 0x43564c43; // "CLVC"
+        static constexpr uint32_t kLayoutVersion = 1;
+
+        uint32_t magic_;
+        uint32_t layoutVersion_;
+        uint64_t argHash_;
+        uint64_t schemaHash_;
+        uint32_t charSize_;
+        uint32_t argCount_;
+        uint32_t optionCount_;
+        uint32_t textSize_;
+        uint32_t textOffset_;
+        uint32_t indicesOffset_;
+        uint32_t foundOffset_;
+        uint32_t valuesOffset_;
+        uint32_t size_;
+    };
+    struct CachedString {
+        uint32_t arg_;
+        uint32_t offset_;
+        uint32_t length_;
+    };
+
+    static uint64_t HashBytes(uint64_t h, void const* data, size_t size);
+    uint64_t HashSchema() const;
+    static bool IsString(Option const& opt);
+    static uint32_t GetCachedSize(Option const& opt) { return IsString(opt) ? (uint32_t) sizeof(CachedString) : opt.valueSize_; }
+    CommandLineOptionsResult ParseCached(char const* cacheDir, int argc, CharT** argv, int* errorArgIndex);
+    bool ApplyCache(Mapping const& mapping, CharT** argv, std::vector<size_t> const& lengths, CacheHeader const& expected);
+    void WriteCache(std::string const& path, CharT** argv, std::vector<size_t> const& lengths, CacheHeader header) const;
+
+    template<typename F>
+    CommandLineOptionsResult ParseConfig(CharT* data, size_t count, int* errorLine, F const& apply);
+    CommandLineOptionsResult ParseConfig(CharT* data, size_t count, int* errorLine);
+};
+
+#ifdef _WIN32
+template<typename CharType>
+bool CommandLineOptionsT<CharType>::Impl::MapFile(char const* path, Mapping* mapping)
+{
+    HANDLE file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file == INVALID_HANDLE_VALUE) {
+        return false;
+    }
+
+    LARGE_INTEGER size;
+    bool ok = GetFileSizeEx(file, &size) != 0;
+    mapping->address_ = nullptr;
+    mapping->size_ = 0;
+    if (ok && size.QuadPart > 0) {
+        // Copy-on-write so that tokenizing in place doesn't modify the file.
+        HANDLE fileMapping = CreateFileMappingA(file, nullptr, PAGE_WRITECOPY, 0, 0, nullptr);
+        if (fileMapping != nullptr) {
+            mapping->address_ = MapViewOfFile(fileMapping, FILE_MAP_COPY, 0, 0, 0);
+            CloseHandle(fileMapping);
+        }
+        ok = mapping->address_ != nullptr;
+        mapping->size_ = (size_t) size.QuadPart;
+    }
+    CloseHandle(file);
+
+    return ok;
+}
+
+template<typename CharType>
+void CommandLineOptionsT<CharType>::Impl::UnmapFile(Mapping const& mapping)
+{
+    if (mapping.address_ != nullptr) {
+        UnmapViewOfFile(mapping.address_);
+    }
+}
+#else
+template<typename CharType>
+bool CommandLineOptionsT<CharType>::Impl::MapFile(char const* path, Mapping* mapping)
+{
+    int fd = open(path, O_RDONLY);
+    if (fd == -1) {
+        return false;
+    }
+
+    struct stat st;
+    bool ok = fstat(fd, &st) == 0;
+    mapping->address_ = nullptr;
+    mapping->size_ = 0;
+    if (ok && st.st_size > 0) {
+        // MAP_PRIVATE so that tokenizing in place doesn't modify the file.
+        auto address = mmap(nullptr, (size_t) st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+        if (address == MAP_FAILED) {
+            ok = false;
+        } else {
+            mapping->address_ = address;
+            mapping->size_ = (size_t) st.st_size;
+        }
+    }
+    close(fd);
+
+    return ok;
+}
+
+template<typename CharType>
+void CommandLineOptionsT<CharType>::Impl::UnmapFile(Mapping const& mapping)
+{
+    if (mapping.address_ != nullptr) {
+        munmap(mapping.address_, mapping.size_);
+    }
+}
+#endif
+
+// Tokenizes a config file, calling apply(opt, value) for each option it sets
+// with the null-terminated value, or nullptr for a flag given without one.
+template<typename CharType>
+template<typename F>
+CommandLineOptionsResult CommandLineOptionsT<CharType>::Impl::ParseConfig(CharT* data, size_t count, int* errorLine, F const& apply)
+{
+    auto IsSpace = [](CharT c) { return c == ' ' || c == '\t' || c == '\r' || c == '\f' || c == '\v'; };
+
+    // Skip a byte order mark.
+    if (count > 0 && (uint32_t) data[0] == 0xfeff) {
+        ++data;
+        --count;
+    } else if (sizeof(CharT) == 1 && count >= 3 && (uint8_t) data[0] == 0xef && (uint8_t) data[1] == 0xbb && (uint8_t) data[2] == 0xbf) {
+        data += 3;
+        count -= 3;
+    }
+
+    CharT const* section = nullptr;
+    size_t sectionLength = 0;
+    std::basic_string<CharT> key;
+
+    int line = 0;
+    auto end = data + count;
+    for (auto p = data; p < end; ) {
+        line += 1;
+
+        auto lineEnd = p;
+        while (lineEnd < end && *lineEnd != '\n') {
+            ++lineEnd;
+        }
+        auto next = lineEnd < end ? lineEnd + 1 : end;
+
+        // Trim the line.
+        while (p < lineEnd && IsSpace(*p)) {
+            ++p;
+        }
+        auto q = lineEnd;
+        while (q > p && IsSpace(q[-1])) {
+            --q;
+        }
+
+        if (p == q || *p == '#' || *p == ';') {
+            p = next;
+            continue;
+        }
+
+        auto Error = [errorLine, line](CommandLineOptionsResult result) {
+            if (errorLine != nullptr) {
+                *errorLine = line;
+            }
+            return result;
+        };
+
+        if (*p == '[') {
+            if (q[-1] != ']') {
+                return Error(CommandLineOptions_ErrorUnrecognisedArgument);
+            }
+            section = p + 1;
+            sectionLength = (size_t) (q - 1 - section);
+            p = next;
+            continue;
+        }
+
+        // Split into name and value.
+        auto nameEnd = p;
+        while (nameEnd < q && *nameEnd != '=') {
+            ++nameEnd;
+        }
+        auto valueBegin = nameEnd;
+        while (nameEnd > p && IsSpace(nameEnd[-1])) {
+            --nameEnd;
+        }
+
+        Option* opt = nullptr;
+        if (sectionLength == 0) {
+            opt = FindOption(p, (size_t) (nameEnd - p), false);
+        } else {
+            key.assign(section, sectionLength);
+            key += (CharT) '.';
+            key.append(p, (size_t) (nameEnd - p));
+            opt = FindOption(key.data(), key.size(), false);
+        }
+        if (opt == nullptr || opt->type_ == Option::ARG) {
+            return Error(CommandLineOptions_ErrorUnrecognisedArgument);
+        }
+
+        if (valueBegin == q) {
+            if (!IsFlag(*opt)) {
+                return Error(CommandLineOptions_ErrorArgumentExpectingValue);
+            }
+            auto result = apply(opt, (CharT*) nullptr);
+            if (result != CommandLineOptions_Ok) {
+                return Error(result);
+            }
+            p = next;
+            continue;
+        }
+
+        auto value = valueBegin + 1;
+        while (value < q && IsSpace(*value)) {
+            ++value;
+        }
+        auto valueEnd = q;
+        if (valueEnd - value >= 2 && *value == '"' && valueEnd[-1] == '"') {
+            ++value;
+            --valueEnd;
+        }
+
+        // Terminate the value in place, unless it runs to the end of the
+        // mapping in which case it is copied.
+        if (valueEnd < end) {
+            *valueEnd = '\0';
+        } else {
+            auto n = (size_t) (valueEnd - value);
+            ownedStrings_.emplace_back(new CharT[n + 1]);
+            auto copy = ownedStrings_.back().get();
+            std::copy(value, valueEnd, copy);
+            copy[n] = '\0';
+            value = copy;
+        }
+
+        auto result = apply(opt, value);
+        if (result != CommandLineOptions_Ok) {
+            return Error(result);
+        }
+
+        p = next;
+    }
+
+    return CommandLineOptions_Ok;
+}
+
+template<typename CharType>
+CommandLineOptionsResult CommandLineOptionsT<CharType>::Impl::ParseConfig(CharT* data, size_t count, int* errorLine)
+{
+    BeginSource(CommandLineOptions_SourceConfigFile);
+    return ParseConfig(data, count, errorLine, [this](Option* opt, CharT* value) {
+        if (IsBlocked(opt)) {
+            return CommandLineOptions_Ok;
+        }
+        auto result = value == nullptr ? SetFlag(opt) : SetValue(opt, value);
+        if (result == CommandLineOptions_Ok) {
+            MarkSet(CommandLineOptions_SourceConfigFile, opt);
+        }
+        return result;
+    });
+}
+
+#ifdef _WIN32
+static DWORD CLOVER_GetModuleFileName(char* path, DWORD size)    { return GetModuleFileNameA(nullptr, path, size); }
+static DWORD CLOVER_GetModuleFileName(wchar_t* path, DWORD size) { return GetModuleFileNameW(nullptr, path, size); }
+#endif
+
+// Calls f(name, isDirectory) for each entry of a directory.
+#ifdef _WIN32
+template<typename F>
+static void CLOVER_ListDirectory(char const* dir, F const& f)
+{
+    WIN32_FIND_DATAA data;
+    HANDLE find = FindFirstFileA((std::string(dir) + "\\*").c_str(), &data);
+    if (find != INVALID_HANDLE_VALUE) {
+        do {
+            f(data.cFileName, (data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) != 0);
+        } while (FindNextFileA(find, &data));
+        FindClose(find);
+    }
+}
+
+template<typename F>
+static void CLOVER_ListDirectory(wchar_t const* dir, F const& f)
+{
+    WIN32_FIND_DATAW data;
+    HANDLE find = FindFirstFileW((std::wstring(dir) + L"\\*").c_str(), &data);
+    if (find != INVALID_HANDLE_VALUE) {
+        do {
+            f(data.cFileName, (data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) != 0);
+        } while (FindNextFileW(find, &data));
+        FindClose(find);
+    }
+}
+#else
+template<typename F>
+static void CLOVER_ListDirectory(char const* dir, F const& f)
+{
+    DIR* d = opendir(dir);
+    if (d == nullptr) {
+        return;
+    }
+    while (auto entry = readdir(d)) {
+        bool isDirectory = false;
+        #ifdef DT_DIR
+        if (entry->d_type != DT_UNKNOWN && entry->d_type != DT_LNK) {
+            isDirectory = entry->d_type == DT_DIR;
+        } else
+        #endif
+        {
+            struct stat st;
+            isDirectory = stat((std::string(dir) + '/' + entry->d_name).c_str(), &st) == 0 && S_ISDIR(st.st_mode);
+        }
+        f(entry->d_name, isDirectory);
+    }
+    closedir(d);
+}
+
+// File names are narrow here, so wchar_t options don't complete them.
+template<typename F>
+static void CLOVER_ListDirectory(wchar_t const*, F const&)
+{
+}
+#endif
+
+template<typename CharType>
+void CommandLineOptionsT<CharType>::Impl::PrintProgramName(FILE* fp) const
+{
+    if (parent_ != nullptr) {
+        parent_->PrintProgramName(fp);
+        Traits::Print(fp, (CharT) ' ');
+        Traits::Print(fp, subcommandName_);
+        return;
+    }
+
+    #ifdef _WIN32
+    CharT path[MAX_PATH];
+    CLOVER_GetModuleFileName(path, MAX_PATH);
+    std::basic_string<CharT> filename(path);
+
+    static CharT const separators[] = { '/', '\\', '\0' };
+    filename.erase(0, filename.find_last_of(separators) + 1);
+
+    auto n = filename.size();
+    if (n > 4 && EqualIgnoreCase(filename.c_str() + n - 4, ".exe")) {
+        filename.resize(n - 4);
+    }
+
+    Traits::Print(fp, filename.c_str());
+    #else
+    if (programName_ != nullptr) {
+        auto filename = programName_;
+        for (auto p = filename; *p; ++p) {
+            if (*p == '/') {
+                filename = p + 1;
+            }
+        }
+        Traits::Print(fp, filename);
+    } else {
+        // No argv yet, so fall back on the name the C library recorded at
+        // startup.
+        #if defined(__GLIBC__) && defined(_GNU_SOURCE)
+        Traits::PrintNarrow(fp, program_invocation_short_name);
+        #elif defined(__APPLE__) || defined(__FreeBSD__) || defined(__NetBSD__) || defined(__OpenBSD__)
+        Traits::PrintNarrow(fp, getprogname());
+        #endif
+    }
+    #endif
+}
+
+template<typename CharType>
+CommandLineOptionsT<CharType>::CommandLineOptionsT()
+    : impl_(new Impl)
+{
+}
+
+template<typename CharType>
+CommandLineOptionsT<CharType>::CommandLineOptionsT(CommandLineOptionsT&& other)
+    : impl_(other.impl_)
+{
+    other.impl_ = new Impl;
+}
+
+template<typename CharType>
+CommandLineOptionsT<CharType>& CommandLineOptionsT<CharType>::operator=(CommandLineOptionsT&& other)
+{
+    std::swap(impl_, other.impl_);
+    return *this;
+}
+
+template<typename CharType>
+CommandLineOptionsT<CharType>::~CommandLineOptionsT()
+{
+    delete impl_;
+}
+
+template<typename CharType>
+CommandLineOptionHandle CommandLineOptionsT<CharType>::AddOption(bool* value, CharT const* name, CharT const* description, bool includeInUsage)
+{
+    return impl_->AddOption(name, nullptr, description, (void*) value, Impl::Option::BOOL, includeInUsage);
+}
+
+template<typename CharType>
+CommandLineOptionHandle CommandLineOptionsT<CharType>::AddOption(CharT** value, CharT const* name, CharT const* valueDesc, CharT const* description, bool includeInUsage)
+{
+    if (valueDesc == nullptr) {
+        return impl_->AddOption(name, valueDesc, description, (void*) value, Impl::Option::ARG, includeInUsage);
+    }
+    return AddValueOption((void*) value, name, valueDesc, description, &Convert<CharT*>, &TypeName<CharT*>, sizeof(CharT*), includeInUsage);
+}
+
+template<typename CharType>
+CommandLineOptionHandle CommandLineOptionsT<CharType>::AddOptions(OptionEntry const* table, size_t count, void* base, bool includeInUsage)
+{
+    auto first = (CommandLineOptionHandle) impl_->options_.size();
+    impl_->options_.reserve(impl_->options_.size() + count);
+    for (size_t i = 0; i < count; ++i) {
+        auto const& entry = table[i];
+        auto value = (void*) ((char*) base + entry.offset_);
+        switch (entry.kind_) {
+        case OptionEntry::Flag:       impl_->AddOption(entry.name_, nullptr, entry.description_, value, Impl::Option::BOOL, includeInUsage); break;
+        case OptionEntry::Positional: impl_->AddOption(entry.name_, nullptr, entry.description_, value, Impl::Option::ARG, includeInUsage); break;
+        default:                      impl_->AddOption(entry.name_, entry.valueDesc_, entry.description_, value, Impl::Option::VALUE, includeInUsage, entry.convert_, entry.size_);
+                                      impl_->options_.back().typeName_ = entry.typeName_;
+                                      break;
+        }
+    }
+    return count == 0 ? CommandLineOptionHandle::Invalid : first;
+}
+
+template<typename CharType>
+CommandLineOptionHandle CommandLineOptionsT<CharType>::AddValueOption(void* value, CharT const* name, CharT const* valueDesc, CharT const* description, ConvertFn convert, TypeNameFn typeName,
+                                                                      uint32_t valueSize, bool includeInUsage)
+{
+    auto handle = impl_->AddOption(name, valueDesc, description, value, Impl::Option::VALUE, includeInUsage, convert, valueSize);
+    impl_->options_.back().typeName_ = typeName;
+    return handle;
+}
+
+template<typename CharType>
+CommandLineOptionHandle CommandLineOptionsT<CharType>::AddAction(CharT const* name, CharT const* valueDesc, CharT const* description, Action const& action, bool includeInUsage)
+{
+    impl_->actions_.emplace_back(action);
+    return impl_->AddOption(name, valueDesc, description, (void*) &impl_->actions_.back(), Impl::Option::ACTION, includeInUsage);
+}
+
+#if CLOVER_ENABLE_RUNTIME
+template<typename CharType>
+CommandLineOptionHandle CommandLineOptionsT<CharType>::AddLiveValueOption(void* value, CharT const* name, CharT const* valueDesc, CharT const* description, ConvertFn convert,
+                                                                          TypeNameFn typeName, LiveFn load, LiveFn store, uint32_t valueSize, bool includeInUsage)
+{
+    auto handle = impl_->AddOption(name, valueDesc, description, value, Impl::Option::VALUE, includeInUsage, convert, valueSize);
+    impl_->options_.back().typeName_ = typeName;
+    impl_->options_.back().loadLive_ = load;
+    impl_->options_.back().storeLive_ = store;
+    return handle;
+}
+
+template<typename CharType>
+CommandLineOptionsResult CommandLineOptionsT<CharType>::SetLiveValue(CommandLineOptionHandle handle, CharT const* text)
+{
+    auto i = (uint32_t) handle;
+    if (i >= impl_->options_.size() || impl_->options_[i].storeLive_ == nullptr) {
+        return CommandLineOptions_ErrorUnrecognisedArgument;
+    }
+
+    // Live values are numbers, so the converter doesn't keep text.
+    std::lock_guard<std::mutex> lock(impl_->liveMutex_);
+    auto result = Impl::SetValue(&impl_->options_[i], (CharT*) text);
+    if (result != CommandLineOptions_Ok) {
+        return result;
+    }
+    impl_->NotifyChanged(std::vector<CommandLineOptionHandle>(1, handle));
+    return CommandLineOptions_Ok;
+}
+
+template<typename CharType>
+void CommandLineOptionsT<CharType>::AddWatcher(CommandLineOptionHandle handle, LiveWatcher watcher, void* context)
+{
+    impl_->watchers_.emplace_back(typename Impl::Watcher{ (uint32_t) handle, watcher, context });
+}
+
+// Frees every snapshot, once there can't be any readers.
+template<typename CharType>
+void CommandLineOptionsT<CharType>::Impl::FreeSnapshots()
+{
+    for (auto const& r : retired_) {
+        ::operator delete(r.snapshot_);
+    }
+    ::operator delete(snapshot_.load());
+}
+
+template<typename CharType>
+uint64_t CommandLineOptionsT<CharType>::PublishSnapshot()
+{
+    std::lock_guard<std::mutex> lock(impl_->liveMutex_);
+    return impl_->Publish();
+}
+
+// Publishes a snapshot of the current values.  The caller holds liveMutex_.
+template<typename CharType>
+uint64_t CommandLineOptionsT<CharType>::Impl::Publish()
+{
+    auto optionCount = (uint32_t) options_.size();
+    auto wordCount = setBits_[0].size();
+
+    // The layout, found set and values follow the snapshot in one block.
+    std::vector<uint32_t> layout;
+    auto valuesSize = LayoutValues(&layout);
+    auto layoutOffset = (sizeof(Snapshot) + 7) & ~(size_t) 7;
+    auto foundOffset = layoutOffset + 2 * sizeof(uint32_t) * ((optionCount + 1) & ~1u);
+    auto valuesOffset = (foundOffset + wordCount * sizeof(uint64_t) + 15) & ~(size_t) 15;
+
+    auto block = (unsigned char*) ::operator new(valuesOffset + valuesSize);
+    auto snapshot = new (block) Snapshot;
+    auto layoutCopy = (uint32_t*) (block + layoutOffset);
+    auto found = (uint64_t*) (block + foundOffset);
+    auto values = block + valuesOffset;
+    memcpy(layoutCopy, layout.data(), layout.size() * sizeof(uint32_t));
+    for (size_t w = 0; w < wordCount; ++w) {
+        found[w] = GetFoundBits(w);
+    }
+    for (uint32_t i = 0; i < optionCount; ++i) {
+        LoadValue(options_[i], values + layout[2 * i]);
+    }
+    snapshot->version_ = ++snapshotVersion_;
+    snapshot->optionCount_ = optionCount;
+    snapshot->layout_ = layoutCopy;
+    snapshot->found_ = found;
+    snapshot->values_ = values;
+
+    // Readers that announce a later epoch than the old snapshot is retired
+    // in started after it was replaced, so can't see it.
+    auto old = snapshot_.exchange(snapshot);
+    if (old != nullptr) {
+        retired_.emplace_back(Retired{ old, epoch_.load() });
+    }
+    epoch_.fetch_add(1);
+    ReclaimSnapshots();
+    return snapshot->version_;
+}
+
+template<typename CharType>
+bool CommandLineOptionsT<CharType>::SetReloadable(CommandLineOptionHandle handle, bool reloadable)
+{
+    auto i = (uint32_t) handle;
+    if (i >= impl_->options_.size()) {
+        return false;
+    }
+    auto& opt = impl_->options_[i];
+    if ((opt.type_ != Impl::Option::BOOL && opt.type_ != Impl::Option::VALUE) || opt.valueSize_ == 0) {
+        return false;
+    }
+    opt.reloadable_ = reloadable;
+    return true;
+}
+
+template<typename CharType>
+CommandLineOptionsResult CommandLineOptionsT<CharType>::ReloadConfigFile(char const* path, CommandLineOptionsReload* reload)
+{
+    std::lock_guard<std::mutex> lock(impl_->liveMutex_);
+    return impl_->Reload(path, reload);
+}
+
+// Converts a value for a BOOL or VALUE option into copy, which holds
+// valueSize_ bytes.  A flag given without a value (value==nullptr) is true.
+template<typename CharType>
+bool CommandLineOptionsT<CharType>::Impl::ConvertValue(Option const& opt, CharT* value, void* copy)
+{
+    if (opt.type_ == Option::BOOL) {
+        bool b = true;
+        if (value != nullptr && !Traits::ParseBool(value, &b)) {
+            return false;
+        }
+        *(bool*) copy = b;
+        return true;
+    }
+    if (opt.choices_ != nullptr &&
+        std::none_of(opt.choices_, opt.choices_ + opt.choiceCount_, [value](CharT const* c) { return EqualIgnoreCase(value, c); })) {
+        return false;
+    }
+    return opt.convert_(copy, value);
+}
+
+// Returns whether a converted value equals an option's current one.  Strings
+// are compared by their text, since they point into their sources.
+template<typename CharType>
+bool CommandLineOptionsT<CharType>::Impl::IsSameValue(Option const& opt, void const* value)
+{
+    alignas(16) unsigned char live[16];
+    void const* current = opt.value_;
+    if (opt.loadLive_ != nullptr) {
+        opt.loadLive_(opt.value_, live);
+        current = live;
+    }
+
+    using StringView = std::basic_string_view<CharT>;
+    if (opt.type_ == Option::ARG || opt.convert_ == &Convert<CharT*> || opt.convert_ == &Convert<CharT const*>) {
+        auto a = *(CharT const* const*) current;
+        auto b = *(CharT const* const*) value;
+        return a == b || (a != nullptr && b != nullptr && StringView(a) == StringView(b));
+    }
+    if (opt.convert_ == &Convert<StringView>) {
+        return *(StringView const*) current == *(StringView const*) value;
+    }
+    return memcmp(current, value, opt.valueSize_) == 0;
+}
+
+// Reloads a config file.  The caller holds liveMutex_.
+template<typename CharType>
+CommandLineOptionsResult CommandLineOptionsT<CharType>::Impl::Reload(char const* path, CommandLineOptionsReload* reload)
+{
+    reloadChanged_.clear();
+    reloadRejected_.clear();
+    auto Finish = [this, reload](CommandLineOptionsResult result, int errorLine) {
+        if (reload != nullptr) {
+            *reload = CommandLineOptionsReload{ result, errorLine,
+                                                reloadChanged_.data(), (uint32_t) reloadChanged_.size(),
+                                                reloadRejected_.data(), (uint32_t) reloadRejected_.size() };
+        }
+        return result;
+    };
+
+    // The file is read rather than mapped, since it may be rewritten in
+    // place later.
+    std::unique_ptr<CharT[]> data;
+    size_t count = 0;
+    if (FILE* fp = fopen(path, "rb")) {
+        std::string bytes;
+        char buffer[4096];
+        for (size_t n; (n = fread(buffer, 1, sizeof(buffer), fp)) > 0; ) {
+            bytes.append(buffer, n);
+        }
+        fclose(fp);
+        count = bytes.size() / sizeof(CharT);
+        data.reset(new CharT[count + 1]);
+        memcpy(data.get(), bytes.data(), count * sizeof(CharT));
+    } else {
+        return Finish(CommandLineOptions_ErrorUnrecognisedArgument, 0);
+    }
+
+    // Convert the file's values into a staging copy of the options' values,
+    // leaving out actions, which aren't values, and options that a higher
+    // priority source set.
+    std::vector<uint32_t> layout;
+    auto size = LayoutValues(&layout);
+    std::unique_ptr<max_align_t[]> staging(new max_align_t[size / sizeof(max_align_t) + 1]);
+    auto values = (unsigned char*) staging.get();
+    std::vector<bool> staged(options_.size(), false);
+
+    BeginSource(CommandLineOptions_SourceConfigFile);
+    int errorLine = 0;
+    auto result = CommandLineOptions_Ok;
+    if (count > 0) {
+        result = ParseConfig(data.get(), count, &errorLine, [&](Option* opt, CharT* value) {
+            auto i = GetIndex(opt);
+            if (opt->type_ == Option::ACTION || IsBlocked(opt)) {
+                return CommandLineOptions_Ok;
+            }
+            if (opt->valueSize_ == 0 || !ConvertValue(*opt, value, values + layout[2 * i])) {
+                return CommandLineOptions_ErrorArgumentValueInvalid;
+            }
+            staged[i] = true;
+            return CommandLineOptions_Ok;
+        });
+    }
+    if (result != CommandLineOptions_Ok) {
+        return Finish(result, errorLine);
+    }
+
+    std::vector<std::unique_ptr<CharT[]>> replaced;
+    for (uint32_t i = 0, n = (uint32_t) options_.size(); i < n; ++i) {
+        auto& opt = options_[i];
+        auto value = values + layout[2 * i];
+        if (!staged[i] || IsSameValue(opt, value)) {
+            continue;
+        }
+        if (!opt.reloadable_) {
+            reloadRejected_.emplace_back((CommandLineOptionHandle) i);
+            continue;
+        }
+
+        // String values are copied out of the file's data, replacing the
+        // option's copy from the last reload, if any.
+        if (IsString(opt)) {
+            using StringView = std::basic_string_view<CharT>;
+            bool isView = opt.type_ == Option::VALUE && opt.convert_ == &Convert<StringView>;
+            auto text = isView ? StringView(*(StringView*) value) : StringView(*(CharT**) value);
+            std::unique_ptr<CharT[]> copy(new CharT[text.size() + 1]);
+            std::copy(text.begin(), text.end(), copy.get());
+            copy[text.size()] = '\0';
+            if (isView) {
+                *(StringView*) value = StringView(copy.get(), text.size());
+            } else {
+                *(CharT**) value = copy.get();
+            }
+            reloadStrings_.resize(options_.size());
+            replaced.emplace_back(std::move(reloadStrings_[i]));
+            reloadStrings_[i] = std::move(copy);
+        }
+        StoreValue(opt, value);
+        MarkSet(CommandLineOptions_SourceConfigFile, &opt);
+        reloadChanged_.emplace_back((CommandLineOptionHandle) i);
+    }
+
+    // Snapshots published before this one may still point at the replaced
+    // strings, so they are freed with the last of them.
+    NotifyChanged(reloadChanged_);
+    if (snapshot_.load() != nullptr) {
+        for (auto& string : replaced) {
+            retiredStrings_.emplace_back(RetiredString{ std::move(string), epoch_.load() - 1 });
+        }
+    }
+    return Finish(CommandLineOptions_Ok, 0);
+}
+
+// Calls the watchers of options that changed, and updates the snapshot and
+// the shared-memory segment if they exist.  The caller holds liveMutex_.
+template<typename CharType>
+void CommandLineOptionsT<CharType>::Impl::NotifyChanged(std::vector<CommandLineOptionHandle> const& changed)
+{
+    if (changed.empty()) {
+        return;
+    }
+    for (auto handle : changed) {
+        for (auto const& w : watchers_) {
+            if (w.option_ == (uint32_t) handle) {
+                w.watcher_(handle, w.context_);
+            }
+        }
+    }
+    if (snapshot_.load() != nullptr) {
+        Publish();
+    }
+    UpdateShared();
+}
+
+template<typename CharType>
+bool CommandLineOptionsT<CharType>::StartReloader(char const* path, ReloadCallback callback, void* context)
+{
+    StopReloader();
+
+#ifdef __linux__
+    // Watch the directory, since editors often replace the file.
+    std::string fullPath(path);
+    auto slash = fullPath.find_last_of('/');
+    auto dir = slash == std::string::npos ? std::string(".") : slash == 0 ? std::string("/") : fullPath.substr(0, slash);
+    auto name = slash == std::string::npos ? fullPath : fullPath.substr(slash + 1);
+
+    int fd = inotify_init1(IN_CLOEXEC);
+    if (fd == -1) {
+        return false;
+    }
+    if (inotify_add_watch(fd, dir.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO) == -1 || pipe(impl_->reloaderPipe_) != 0) {
+        close(fd);
+        return false;
+    }
+
+    impl_->reloadPath_ = fullPath;
+    auto impl = impl_;
+    impl_->reloader_ = std::thread([impl, fd, name, callback, context]() {
+        impl->RunReloader(fd, name, callback, context);
+    });
+    return true;
+#else
+    (void) path;
+    (void) callback;
+    (void) context;
+    return false;
+#endif
+}
+
+template<typename CharType>
+void CommandLineOptionsT<CharType>::StopReloader()
+{
+    impl_->StopReloader();
+}
+
+template<typename CharType>
+void CommandLineOptionsT<CharType>::Impl::StopReloader()
+{
+#ifdef __linux__
+    if (!reloader_.joinable()) {
+        return;
+    }
+    char c = 0;
+    while (write(reloaderPipe_[1], &c, 1) == -1 && errno == EINTR) {
+    }
+    reloader_.join();
+    close(reloaderPipe_[0]);
+    close(reloaderPipe_[1]);
+    reloaderPipe_[0] = -1;
+    reloaderPipe_[1] = -1;
+#endif
+}
+
+#ifdef __linux__
+// The reloader thread's loop, which runs until StopReloader() writes to the
+// pipe.  The callback is called with liveMutex_ held, so that the results
+// stay valid.
+template<typename CharType>
+void CommandLineOptionsT<CharType>::Impl::RunReloader(int inotifyFd, std::string name, ReloadCallback callback, void* context)
+{
+    alignas(inotify_event) char buffer[4096];
+    pollfd fds[2] = { { inotifyFd, POLLIN, 0 }, { reloaderPipe_[0], POLLIN, 0 } };
+    for (;;) {
+        if (poll(fds, 2, -1) == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            break;
+        }
+        if (fds[1].revents != 0) {
+            break;
+        }
+
+        auto n = read(inotifyFd, buffer, sizeof(buffer));
+        bool modified = false;
+        for (ssize_t offset = 0; offset < n; ) {
+            auto event = (inotify_event const*) (buffer + offset);
+            modified |= event->len > 0 && name == event->name;
+            offset += (ssize_t) (sizeof(inotify_event) + event->len);
+        }
+        if (!modified) {
+            continue;
+        }
+
+        std::lock_guard<std::mutex> lock(liveMutex_);
+        CommandLineOptionsReload reload;
+        Reload(reloadPath_.c_str(), &reload);
+        if (callback != nullptr) {
+            callback(reload, context);
+        }
+    }
+    close(inotifyFd);
+}
+#endif
+
+template<typename CharType>
+CommandLineOptionsResult CommandLineOptionsT<CharType>::ParseIncremental(int argc, CharT** argv, int* errorArgIndex,
+                                                                          CommandLineOptionHandle* changed, uint32_t capacity, uint32_t* changedCount)
+{
+    std::lock_guard<std::mutex> lock(impl_->liveMutex_);
+    auto result = impl_->ParseIncremental(argc, argv, errorArgIndex);
+    auto const& parseChanged = impl_->parseChanged_;
+    if (changed != nullptr) {
+        std::copy_n(parseChanged.begin(), std::min(capacity, (uint32_t) parseChanged.size()), changed);
+    }
+    if (changedCount != nullptr) {
+        *changedCount = (uint32_t) parseChanged.size();
+    }
+    return result;
+}
+
+// 64-bit FNV-1a over an argument's characters.
+template<typename CharType>
+uint64_t CommandLineOptionsT<CharType>::Impl::HashArgument(CharT const* arg)
+{
+    uint64_t h = 14695981039346656037ull;
+    for (; *arg != '\0'; ++arg) {
+        h = (h ^ (uint64_t) (uint32_t) *arg) * 1099511628211ull;
+    }
+    return h;
+}
+
+// Matches an argument that sets a bool or value option of this instance by
+// itself, as ParseArguments() would (e.g., "--name=value" or "-flag").
+// Returns false for any other argument, including invalid ones.
+template<typename CharType>
+bool CommandLineOptionsT<CharType>::Impl::MatchArgument(CharT* arg, ParsedArg* parsed)
+{
+    auto name = arg;
+    bool isShort = false;
+    if (*name == '/') {
+        ++name;
+    } else if (*name == '-') {
+        ++name;
+        if (*name == '-') {
+            ++name;
+        } else {
+            isShort = true;
+        }
+    } else {
+        return false;
+    }
+    if (EqualIgnoreCase(name, "?") || EqualIgnoreCase(name, "h") || EqualIgnoreCase(name, "help") ||
+        (Traits::FoldCase(name[0]) == 'h' && Traits::FoldCase(name[1]) == 'e' &&
+         Traits::FoldCase(name[2]) == 'l' && Traits::FoldCase(name[3]) == 'p' && name[4] == '=')) {
+        return false;
+    }
+
+    auto value = name;
+    while (*value != '\0' && *value != '=') {
+        ++value;
+    }
+    Impl* owner = nullptr;
+    auto opt = FindOptionInScope(name, (size_t) (value - name), &owner);
+    if (opt == nullptr && isShort && FindShortOptionInScope(*name, &owner) != nullptr) {
+        return false;
+    }
+    if (opt == nullptr && value != name) {
+        bool ambiguous = false;
+        opt = FindAbbreviationInScope(name, (size_t) (value - name), &owner, &ambiguous);
+    }
+    if (opt == nullptr || owner != this || opt->valueSize_ == 0) {
+        return false;
+    }
+
+    parsed->option_ = GetIndex(opt);
+    if (opt->type_ == Option::BOOL && *value == '\0') {
+        parsed->valueOffset_ = 0;
+        return true;
+    }
+    if (opt->type_ == Option::VALUE && *value == '=') {
+        parsed->valueOffset_ = (uint32_t) (value + 1 - arg);
+        return true;
+    }
+    return false;
+}
+
+// Parses a command line, reusing the matches of the arguments that the last
+// call also had.  The caller holds liveMutex_.
+template<typename CharType>
+CommandLineOptionsResult CommandLineOptionsT<CharType>::Impl::ParseIncremental(int argc, CharT** argv, int* errorArgIndex)
+{
+    parseChanged_.clear();
+    auto optionCount = (uint32_t) options_.size();
+    std::vector<uint32_t> layout;
+    auto size = LayoutValues(&layout);
+
+    // Adding options changes the layout, and may change what arguments
+    // match, so start again.
+    bool reparsable = reparsable_ && defaultOffsets_.size() == optionCount;
+
+    // Pair each argument with an unused one from the last call that has the
+    // same hash, or else match it.
+    auto argCount = argc > 1 ? (uint32_t) argc - 1 : 0;
+    std::vector<ParsedArg> args(argCount, ParsedArg{ 0, UINT32_MAX, 0 });
+    std::vector<bool> matched(argCount, false);
+    for (uint32_t i = 0; i < argCount; ++i) {
+        args[i].hash_ = HashArgument(argv[i + 1]);
+    }
+    if (reparsable) {
+        std::vector<std::pair<uint64_t, uint32_t>> previous;
+        previous.reserve(parsedArgs_.size());
+        for (uint32_t i = 0, n = (uint32_t) parsedArgs_.size(); i < n; ++i) {
+            previous.emplace_back(parsedArgs_[i].hash_, i);
+        }
+        std::sort(previous.begin(), previous.end());
+        std::vector<bool> used(previous.size(), false);
+
+        for (uint32_t i = 0; i < argCount && reparsable; ++i) {
+            auto p = std::lower_bound(previous.begin(), previous.end(), std::make_pair(args[i].hash_, 0u));
+            while (p != previous.end() && p->first == args[i].hash_ && used[p - previous.begin()]) {
+                ++p;
+            }
+            if (p != previous.end() && p->first == args[i].hash_) {
+                used[p - previous.begin()] = true;
+                args[i] = parsedArgs_[p->second];
+            } else {
+                reparsable = MatchArgument(argv[i + 1], &args[i]);
+                matched[i] = true;
+            }
+        }
+    }
+    if (reparsable) {
+        return Reparse(argc, argv, errorArgIndex, args, matched);
+    }
+
+    // Otherwise parse everything again, which first undoes the last command
+    // line, and compare every value afterwards.
+    std::unique_ptr<max_align_t[]> before(new max_align_t[size / sizeof(max_align_t) + 1]);
+    auto beforeValues = (unsigned char*) before.get();
+    auto commandLineBits = setBits_[CommandLineOptions_SourceCommandLine];
+    for (uint32_t i = 0; i < optionCount; ++i) {
+        LoadValue(options_[i], beforeValues + layout[2 * i]);
+    }
+
+    auto result = Parse(argc, argv, errorArgIndex);
+    for (uint32_t i = 0; i < optionCount; ++i) {
+        auto const& opt = options_[i];
+        bool changed = opt.valueSize_ != 0 ? !IsSameValue(opt, beforeValues + layout[2 * i]) :
+                       opt.type_ == Option::VALUE && (TestBit(commandLineBits, i) || TestBit(setBits_[CommandLineOptions_SourceCommandLine], i));
+        if (changed) {
+            parseChanged_.emplace_back((CommandLineOptionHandle) i);
+        }
+    }
+
+    // The next call can only reuse these if every one set an option itself.
+    reparsable_ = result == CommandLineOptions_Ok && subcommand_ == nullptr;
+    for (uint32_t i = 0; i < argCount && reparsable_; ++i) {
+        reparsable_ = MatchArgument(argv[i + 1], &args[i]);
+    }
+    parsedArgs_ = std::move(args);
+    NotifyChanged(parseChanged_);
+    return result;
+}
+
+// Applies a command line whose arguments all set options by themselves.
+// args holds their matches, and matched the ones that changed since the last
+// call, which are converted; otherwise an option's value only changes if the
+// argument that decides it does.
+template<typename CharType>
+CommandLineOptionsResult CommandLineOptionsT<CharType>::Impl::Reparse(int argc, CharT** argv, int* errorArgIndex, std::vector<ParsedArg>& args, std::vector<bool> const& matched)
+{
+    ResetResults(argc, argv);
+    RecordDefaults();
+    auto optionCount = (uint32_t) options_.size();
+    std::vector<uint32_t> layout;
+    auto size = LayoutValues(&layout);
+    std::unique_ptr<max_align_t[]> staging(new max_align_t[size / sizeof(max_align_t) + 1]);
+    auto values = (unsigned char*) staging.get();
+    auto defaults = (unsigned char const*) defaults_.data();
+
+    // The last argument for each option decides its value.
+    std::vector<int> last(optionCount, -1);
+    std::vector<int> lastBefore(optionCount, -1);
+    for (uint32_t i = 0, n = (uint32_t) args.size(); i < n; ++i) {
+        last[args[i].option_] = (int) i;
+    }
+    for (uint32_t i = 0, n = (uint32_t) parsedArgs_.size(); i < n; ++i) {
+        lastBefore[parsedArgs_[i].option_] = (int) i;
+    }
+
+    // Convert every changed argument, so that an invalid one is an error even
+    // if a later one overrides it, as it is for Parse().  Then convert the
+    // unchanged ones that now decide an option's value, or that give a
+    // string value, which must point at the new argument.
+    auto ConvertArg = [&](uint32_t i) {
+        auto const& arg = args[i];
+        auto value = arg.valueOffset_ == 0 ? nullptr : argv[i + 1] + arg.valueOffset_;
+        if (ConvertValue(options_[arg.option_], value, values + layout[2 * arg.option_])) {
+            return true;
+        }
+        if (errorArgIndex != nullptr) {
+            *errorArgIndex = (int) i + 1;
+        }
+        reparsable_ = false;
+        return false;
+    };
+    for (uint32_t i = 0, n = (uint32_t) args.size(); i < n; ++i) {
+        if (matched[i] && !ConvertArg(i)) {
+            return CommandLineOptions_ErrorArgumentValueInvalid;
+        }
+    }
+    using StringView = std::basic_string_view<CharT>;
+    std::vector<bool> decided(optionCount, false);
+    for (uint32_t i = 0; i < optionCount; ++i) {
+        auto const& opt = options_[i];
+        auto a = last[i];
+        auto b = lastBefore[i];
+        if (a == -1) {
+            continue;
+        }
+        bool isString = opt.convert_ == &Convert<CharT*> || opt.convert_ == &Convert<CharT const*> || opt.convert_ == &Convert<StringView>;
+        decided[i] = b == -1 || args[a].hash_ != parsedArgs_[b].hash_;
+        if (!matched[a] && (decided[i] || isString) && !ConvertArg((uint32_t) a)) {
+            return CommandLineOptions_ErrorArgumentValueInvalid;
+        }
+        if (!decided[i] && isString) {
+            StoreValue(opt, values + layout[2 * i]);
+        }
+    }
+
+    // Options removed from the command line go back to their values below
+    // it.
+    auto& commandLineBits = setBits_[CommandLineOptions_SourceCommandLine];
+    for (uint32_t i = 0; i < optionCount; ++i) {
+        auto const& opt = options_[i];
+        auto value = values + layout[2 * i];
+        if (last[i] != -1) {
+            commandLineBits[i / 64] |= 1ull << (i % 64);
+            argIndices_[i] = last[i] + 1;
+        } else if (lastBefore[i] != -1) {
+            commandLineBits[i / 64] &= ~(1ull << (i % 64));
+            memcpy(value, defaults + defaultOffsets_[i], opt.valueSize_);
+            decided[i] = true;
+        }
+        if (decided[i] && !IsSameValue(opt, value)) {
+            StoreValue(opt, value);
+            parseChanged_.emplace_back((CommandLineOptionHandle) i);
+        }
+    }
+
+    parsedArgs_ = std::move(args);
+    NotifyChanged(parseChanged_);
+
+    ErrorSink sink{ errorArgIndex, nullptr, 0, 0, CommandLineOptions_Ok };
+    if (!deferConstraints_) {
+        CheckConstraints(&sink, nullptr);
+    }
+    return sink.result_;
+}
+
+// Offsets are from the start of the segment, which the header begins.  A
+// string value is the offset of its text, or 0 for nullptr, and names and
+// strings are terminated.  found_ is a bitset over the entries.
+template<typename CharType>
+struct CommandLineSharedOptionsT<CharType>::Header {
+    static constexpr uint32_t kMagic = 0x53564c43; // "CLVS"
+    static constexpr uint32_t kLayoutVersion = 2;
+
+    std::atomic<uint64_t> sequence_; // odd while the rest is being written
+    uint32_t magic_;
+    uint32_t layoutVersion_;
+    uint32_t charSize_;
+    uint32_t size_;
+    uint32_t optionCount_;
+    uint32_t entriesOffset_;
+    uint32_t foundOffset_;
+    uint32_t valuesOffset_;
+    int32_t writerPid_;
+};
+
+// Readers in other processes load the same counter, which only works if it
+// isn't implemented with a lock local to this one.
+static_assert(std::atomic<uint64_t>::is_always_lock_free, "the shared segment's sequence number must be lock-free");
+
+template<typename CharType>
+struct CommandLineSharedOptionsT<CharType>::Entry {
+    uint32_t handle_;
+    uint32_t kind_;
+    uint32_t nameOffset_;
+    uint32_t valueOffset_;
+    uint32_t valueSize_;
+};
+
+template<typename CharType>
+bool CommandLineOptionsT<CharType>::PublishToSharedMemory(char const* name)
+{
+    std::lock_guard<std::mutex> lock(impl_->liveMutex_);
+    impl_->CloseShared();
+#ifdef _WIN32
+    (void) name;
+    return false;
+#else
+    // Readers may still have a segment left by an earlier process mapped, so
+    // make a new one rather than resizing it under them.  One that a running
+    // process wrote is left alone.
+    int fd = shm_open(name, O_CREAT | O_EXCL | O_RDWR, 0644);
+    if (fd == -1 && errno == EEXIST && Impl::IsStaleShared(name)) {
+        shm_unlink(name);
+        fd = shm_open(name, O_CREAT | O_EXCL | O_RDWR, 0644);
+    }
+    if (fd == -1) {
+        return false;
+    }
+    impl_->sharedName_ = name;
+    impl_->sharedFd_ = fd;
+    impl_->UpdateShared();
+    return impl_->shared_ != nullptr;
+#endif
+}
+
+template<typename CharType>
+void CommandLineOptionsT<CharType>::UpdateSharedMemory()
+{
+    std::lock_guard<std::mutex> lock(impl_->liveMutex_);
+    impl_->UpdateShared();
+}
+
+template<typename CharType>
+CommandLineOptionsValueKind CommandLineOptionsT<CharType>::Impl::GetValueKind(Option const& opt)
+{
+    if (opt.type_ == Option::BOOL || ConvertsTo<bool>(opt)) {
+        return CommandLineOptions_ValueBool;
+    }
+    if (IsString(opt)) {
+        return CommandLineOptions_ValueString;
+    }
+    if (ConvertsTo<char>(opt)) {
+        return std::is_signed<char>::value ? CommandLineOptions_ValueInt : CommandLineOptions_ValueUInt;
+    }
+    if (ConvertsTo<signed char, short, int, long, long long>(opt)) {
+        return CommandLineOptions_ValueInt;
+    }
+    if (ConvertsTo<unsigned char, unsigned short, unsigned int, unsigned long, unsigned long long>(opt)) {
+        return CommandLineOptions_ValueUInt;
+    }
+    if (ConvertsTo<float, double, long double>(opt)) {
+        return CommandLineOptions_ValueFloat;
+    }
+    return CommandLineOptions_ValueOther;
+}
+
+// Writes the options to the shared-memory segment under its sequence lock,
+// growing it first if need be.  The caller holds liveMutex_.
+template<typename CharType>
+void CommandLineOptionsT<CharType>::Impl::UpdateShared()
+{
+#ifndef _WIN32
+    if (sharedFd_ == -1) {
+        return;
+    }
+    using Header = typename SharedOptions::Header;
+    using Entry = typename SharedOptions::Entry;
+    auto Align = [](size_t n, size_t a) { return (n + a - 1) & ~(a - 1); };
+
+    // Build the new contents in memory: the header, the entries, the found
+    // set, the values and then the names and strings.
+    std::vector<uint32_t> included;
+    for (uint32_t i = 0, n = (uint32_t) options_.size(); i < n; ++i) {
+        auto type = options_[i].type_;
+        if (type == Option::BOOL || type == Option::ARG || type == Option::VALUE) {
+            included.emplace_back(i);
+        }
+    }
+    auto count = (uint32_t) included.size();
+    auto entriesOffset = Align(sizeof(Header), 8);
+    auto foundOffset = Align(entriesOffset + count * sizeof(Entry), 8);
+    auto valuesOffset = Align(foundOffset + (count + 63) / 64 * sizeof(uint64_t), 16);
+
+    std::vector<Entry> entries(count);
+    auto offset = valuesOffset;
+    for (uint32_t e = 0; e < count; ++e) {
+        auto const& opt = options_[included[e]];
+        auto kind = GetValueKind(opt);
+        uint32_t size = kind == CommandLineOptions_ValueString ? (uint32_t) sizeof(uint32_t) : opt.valueSize_;
+        offset = Align(offset, size >= 16 ? 16 : size >= 8 ? 8 : size >= 4 ? 4 : size >= 2 ? 2 : 1);
+        entries[e] = Entry{ included[e], (uint32_t) kind, 0, (uint32_t) offset, size };
+        offset += size;
+    }
+
+    std::vector<unsigned char> image(offset);
+    auto AddString = [&image, &Align](CharT const* s, size_t n) {
+        auto at = Align(image.size(), sizeof(CharT));
+        image.resize(at + (n + 1) * sizeof(CharT), 0);
+        memcpy(image.data() + at, s, n * sizeof(CharT));
+        return (uint32_t) at;
+    };
+    std::vector<uint64_t> found((count + 63) / 64, 0);
+    for (uint32_t e = 0; e < count; ++e) {
+        auto& entry = entries[e];
+        auto const& opt = options_[entry.handle_];
+        entry.nameOffset_ = AddString(opt.name_, opt.nameLength_);
+        if (entry.kind_ == CommandLineOptions_ValueString) {
+            std::basic_string_view<CharT> text;
+            if (opt.type_ == Option::VALUE && ConvertsTo<std::basic_string_view<CharT>>(opt)) {
+                text = *(std::basic_string_view<CharT> const*) opt.value_;
+            } else if (auto p = *(CharT const* const*) opt.value_) {
+                text = p;
+            }
+            uint32_t at = text.data() == nullptr ? 0 : AddString(text.data(), text.size());
+            memcpy(image.data() + entry.valueOffset_, &at, sizeof(at));
+        } else if (entry.valueSize_ != 0) {
+            LoadValue(opt, image.data() + entry.valueOffset_);
+        }
+        if ((GetFoundBits(entry.handle_ / 64) >> (entry.handle_ % 64)) & 1) {
+            found[e / 64] |= 1ull << (e % 64);
+        }
+    }
+    memcpy(image.data() + entriesOffset, entries.data(), count * sizeof(Entry));
+    memcpy(image.data() + foundOffset, found.data(), found.size() * sizeof(uint64_t));
+
+    auto header = new (image.data()) Header;
+    header->magic_ = Header::kMagic;
+    header->layoutVersion_ = Header::kLayoutVersion;
+    header->charSize_ = (uint32_t) sizeof(CharT);
+    header->size_ = (uint32_t) image.size();
+    header->optionCount_ = count;
+    header->entriesOffset_ = (uint32_t) entriesOffset;
+    header->foundOffset_ = (uint32_t) foundOffset;
+    header->valuesOffset_ = (uint32_t) valuesOffset;
+    header->writerPid_ = (int32_t) getpid();
+
+    // Readers map the segment again if its size_ is larger than their
+    // mapping, so it can grow but never shrink.
+    if (image.size() > sharedSize_) {
+        auto size = Align(std::max(image.size(), 2 * sharedSize_), 4096);
+        void* mapping = MAP_FAILED;
+        if (ftruncate(sharedFd_, (off_t) size) == 0) {
+            mapping = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, sharedFd_, 0);
+        }
+        if (mapping == MAP_FAILED) {
+            CloseShared();
+            return;
+        }
+        if (shared_ != nullptr) {
+            munmap(shared_, sharedSize_);
+        }
+        shared_ = (unsigned char*) mapping;
+        sharedSize_ = size;
+    }
+
+    // Everything after the sequence number is written while it's odd.
+    auto shared = (Header*) shared_;
+    auto sequence = shared->sequence_.load(std::memory_order_relaxed);
+    shared->sequence_.store(sequence + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    auto begin = sizeof(shared->sequence_);
+    memcpy(shared_ + begin, image.data() + begin, image.size() - begin);
+    shared->sequence_.store(sequence + 2, std::memory_order_release);
+#endif
+}
+
+// Whether a segment can be replaced: unless its header names a writer that
+// is still running.  A segment too small for a header (e.g., from a writer
+// that crashed before writing one) or with another magic number or layout
+// version (e.g., from an older Clover) names none.
+template<typename CharType>
+bool CommandLineOptionsT<CharType>::Impl::IsStaleShared(char const* name)
+{
+#ifdef _WIN32
+    (void) name;
+    return false;
+#else
+    using Header = typename SharedOptions::Header;
+    int fd = shm_open(name, O_RDONLY, 0);
+    if (fd == -1) {
+        return false;
+    }
+    bool stale = false;
+    struct stat st;
+    if (fstat(fd, &st) == 0) {
+        stale = (size_t) st.st_size < sizeof(Header);
+        void* mapping = stale ? MAP_FAILED : mmap(nullptr, sizeof(Header), PROT_READ, MAP_SHARED, fd, 0);
+        if (mapping != MAP_FAILED) {
+            auto header = (Header const*) mapping;
+            bool hasWriter = header->magic_ == Header::kMagic && header->layoutVersion_ == Header::kLayoutVersion && header->writerPid_ > 0;
+            stale = !hasWriter || (kill((pid_t) header->writerPid_, 0) == -1 && errno == ESRCH);
+            munmap(mapping, sizeof(Header));
+        }
+    }
+    close(fd);
+    return stale;
+#endif
+}
+
+template<typename CharType>
+void CommandLineOptionsT<CharType>::Impl::CloseShared()
+{
+#ifndef _WIN32
+    if (shared_ != nullptr) {
+        munmap(shared_, sharedSize_);
+    }
+    if (sharedFd_ != -1) {
+        close(sharedFd_);
+        shm_unlink(sharedName_.c_str());
+    }
+#endif
+    shared_ = nullptr;
+    sharedSize_ = 0;
+    sharedFd_ = -1;
+}
+
+template<typename CharType>
+CommandLineSharedOptionsT<CharType>::~CommandLineSharedOptionsT()
+{
+    Close();
+    delete[] copy_;
+}
+
+template<typename CharType>
+bool CommandLineSharedOptionsT<CharType>::Open(char const* name)
+{
+    Close();
+#ifdef _WIN32
+    (void) name;
+    return false;
+#else
+    fd_ = shm_open(name, O_RDONLY, 0);
+    if (fd_ == -1) {
+        return false;
+    }
+    if (!Map()) {
+        Close();
+        return false;
+    }
+    return true;
+#endif
+}
+
+template<typename CharType>
+void CommandLineSharedOptionsT<CharType>::Close()
+{
+#ifndef _WIN32
+    if (mapping_ != nullptr) {
+        munmap((void*) mapping_, mappingSize_);
+    }
+    if (fd_ != -1) {
+        close(fd_);
+    }
+#endif
+    mapping_ = nullptr;
+    mappingSize_ = 0;
+    fd_ = -1;
+}
+
+// Maps the whole segment, which may have grown since it was last mapped.
+template<typename CharType>
+bool CommandLineSharedOptionsT<CharType>::Map()
+{
+#ifdef _WIN32
+    return false;
+#else
+    struct stat st;
+    if (fstat(fd_, &st) != 0 || (size_t) st.st_size < sizeof(Header)) {
+        return false;
+    }
+    auto mapping = mmap(nullptr, (size_t) st.st_size, PROT_READ, MAP_SHARED, fd_, 0);
+    if (mapping == MAP_FAILED) {
+        return false;
+    }
+    if (mapping_ != nullptr) {
+        munmap((void*) mapping_, mappingSize_);
+    }
+    mapping_ = (unsigned char const*) mapping;
+    mappingSize_ = (size_t) st.st_size;
+    return true;
+#endif
+}
+
+template<typename CharType>
+bool CommandLineSharedOptionsT<CharType>::Read()
+{
+    if (mapping_ == nullptr) {
+        return false;
+    }
+
+    // Copy the segment between two reads of an even sequence number that
+    // match, giving up if the writer never leaves it alone for long enough.
+    for (int attempt = 0; attempt < 1000; ++attempt) {
+        auto shared = (Header const*) mapping_;
+        auto sequence = shared->sequence_.load(std::memory_order_acquire);
+        if (sequence == 0) {
+            return false;
+        }
+        if ((sequence & 1) != 0) {
+            std::this_thread::yield();
+            continue;
+        }
+        size_t size = shared->size_;
+        if (size > mappingSize_) {
+            if (!Map()) {
+                return false;
+            }
+            continue;
+        }
+        if (size < sizeof(Header)) {
+            continue;
+        }
+
+        // A zero after the end terminates any string that isn't.
+        std::unique_ptr<max_align_t[]> copy(new max_align_t[(size + sizeof(CharT)) / sizeof(max_align_t) + 1]);
+        auto bytes = (unsigned char*) copy.get();
+        memcpy(bytes, mapping_, size);
+        memset(bytes + size, 0, sizeof(CharT));
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (shared->sequence_.load(std::memory_order_relaxed) != sequence) {
+            continue;
+        }
+
+        // Check the layout before using it.
+        auto header = (Header const*) bytes;
+        auto count = (size_t) header->optionCount_;
+        bool valid = header->magic_ == Header::kMagic && header->layoutVersion_ == Header::kLayoutVersion &&
+                     header->charSize_ == sizeof(CharT) && header->size_ == size &&
+                     header->entriesOffset_ % 8 == 0 && header->entriesOffset_ + count * sizeof(Entry) <= size &&
+                     header->foundOffset_ % 8 == 0 && header->foundOffset_ + (count + 63) / 64 * sizeof(uint64_t) <= size;
+        for (size_t i = 0; i < count && valid; ++i) {
+            auto entry = (Entry const*) (bytes + header->entriesOffset_) + i;
+            valid = entry->nameOffset_ < size && entry->nameOffset_ % sizeof(CharT) == 0 &&
+                    entry->valueOffset_ + (size_t) entry->valueSize_ <= size;
+            if (valid && entry->kind_ == CommandLineOptions_ValueString) {
+                uint32_t at = 0;
+                valid = entry->valueSize_ == sizeof(at);
+                if (valid) {
+                    memcpy(&at, bytes + entry->valueOffset_, sizeof(at));
+                    valid = at < size && at % sizeof(CharT) == 0;
+                }
+            }
+        }
+        if (!valid) {
+            return false;
+        }
+
+        delete[] copy_;
+        copy_ = copy.release();
+        version_ = sequence / 2;
+        return true;
+    }
+    return false;
+}
+
+template<typename CharType>
+uint32_t CommandLineSharedOptionsT<CharType>::GetOptionCount() const
+{
+    return copy_ == nullptr ? 0 : GetHeader()->optionCount_;
+}
+
+template<typename CharType>
+typename CommandLineSharedOptionsT<CharType>::Entry const* CommandLineSharedOptionsT<CharType>::GetEntry(uint32_t i) const
+{
+    if (i >= GetOptionCount()) {
+        return nullptr;
+    }
+    return (Entry const*) ((unsigned char const*) copy_ + GetHeader()->entriesOffset_) + i;
+}
+
+template<typename CharType>
+CharType const* CommandLineSharedOptionsT<CharType>::GetName(uint32_t i) const
+{
+    auto entry = GetEntry(i);
+    return entry == nullptr ? nullptr : (CharT const*) ((unsigned char const*) copy_ + entry->nameOffset_);
+}
+
+template<typename CharType>
+CommandLineOptionHandle CommandLineSharedOptionsT<CharType>::GetHandle(uint32_t i) const
+{
+    auto entry = GetEntry(i);
+    return entry == nullptr ? CommandLineOptionHandle::Invalid : (CommandLineOptionHandle) entry->handle_;
+}
+
+template<typename CharType>
+CommandLineOptionsValueKind CommandLineSharedOptionsT<CharType>::GetKind(uint32_t i) const
+{
+    auto entry = GetEntry(i);
+    return entry == nullptr ? CommandLineOptions_ValueOther : (CommandLineOptionsValueKind) entry->kind_;
+}
+
+template<typename CharType>
+bool CommandLineSharedOptionsT<CharType>::WasFound(uint32_t i) const
+{
+    if (i >= GetOptionCount()) {
+        return false;
+    }
+    auto found = (uint64_t const*) ((unsigned char const*) copy_ + GetHeader()->foundOffset_);
+    return (found[i / 64] >> (i % 64)) & 1;
+}
+
+template<typename CharType>
+uint32_t CommandLineSharedOptionsT<CharType>::Find(CharT const* name) const
+{
+    using Traits = CommandLineOptionsTraits<CharT>;
+    for (uint32_t i = 0, n = GetOptionCount(); i < n; ++i) {
+        auto a = GetName(i);
+        auto b = name;
+        while (*a != '\0' && Traits::FoldCase(*a) == Traits::FoldCase(*b)) {
+            ++a;
+            ++b;
+        }
+        if (*a == '\0' && *b == '\0') {
+            return i;
+        }
+    }
+    return UINT32_MAX;
+}
+
+template<typename CharType>
+void const* CommandLineSharedOptionsT<CharType>::GetValue(uint32_t i, uint32_t size) const
+{
+    auto entry = GetEntry(i);
+    if (entry == nullptr || entry->kind_ == CommandLineOptions_ValueString || entry->valueSize_ != size) {
+        return nullptr;
+    }
+    return (unsigned char const*) copy_ + entry->valueOffset_;
+}
+
+template<typename CharType>
+CharType const* CommandLineSharedOptionsT<CharType>::GetString(uint32_t i) const
+{
+    auto entry = GetEntry(i);
+    if (entry == nullptr || entry->kind_ != CommandLineOptions_ValueString) {
+        return nullptr;
+    }
+    uint32_t at = 0;
+    memcpy(&at, (unsigned char const*) copy_ + entry->valueOffset_, sizeof(at));
+    return at == 0 ? nullptr : (CharT const*) ((unsigned char const*) copy_ + at);
+}
+
+// Frees the retired snapshots, and strings, that no reader can be using.  The
+// caller holds liveMutex_.
+template<typename CharType>
+void CommandLineOptionsT<CharType>::Impl::ReclaimSnapshots()
+{
+    auto oldest = UINT64_MAX;
+    {
+        std::lock_guard<std::mutex> lock(readerMutex_);
+        for (auto const& slot : readerSlots_) {
+            auto epoch = slot.epoch_.load();
+            if (epoch != 0 && epoch < oldest) {
+                oldest = epoch;
+            }
+        }
+    }
+    auto end = std::remove_if(retired_.begin(), retired_.end(), [oldest](Retired const& r) {
+        if (r.epoch_ >= oldest) {
+            return false;
+        }
+        ::operator delete(r.snapshot_);
+        return true;
+    });
+    retired_.erase(end, retired_.end());
+    auto stringsEnd = std::remove_if(retiredStrings_.begin(), retiredStrings_.end(), [oldest](RetiredString const& r) {
+        return r.epoch_ < oldest;
+    });
+    retiredStrings_.erase(stringsEnd, retiredStrings_.end());
+}
+
+template<typename CharType>
+typename CommandLineOptionsT<CharType>::SnapshotReader CommandLineOptionsT<CharType>::AddSnapshotReader()
+{
+    std::lock_guard<std::mutex> lock(impl_->readerMutex_);
+    for (auto& slot : impl_->readerSlots_) {
+        if (!slot.used_) {
+            slot.used_ = true;
+            return SnapshotReader(&slot);
+        }
+    }
+    impl_->readerSlots_.emplace_back();
+    auto& slot = impl_->readerSlots_.back();
+    slot.impl_ = impl_;
+    slot.used_ = true;
+    return SnapshotReader(&slot);
+}
+
+template<typename CharType>
+CommandLineOptionsT<CharType>::SnapshotReader::SnapshotReader(SnapshotReader&& other)
+    : slot_(other.slot_)
+{
+    other.slot_ = nullptr;
+}
+
+template<typename CharType>
+CommandLineOptionsT<CharType>::SnapshotReader::~SnapshotReader()
+{
+    if (slot_ != nullptr) {
+        Release();
+        std::lock_guard<std::mutex> lock(slot_->impl_->readerMutex_);
+        slot_->used_ = false;
+    }
+}
+
+// Announcing the epoch before loading the pointer means that either the
+// writer sees the announcement and keeps the snapshot, or the load sees the
+// snapshot that replaced it.
+template<typename CharType>
+typename CommandLineOptionsT<CharType>::Snapshot const* CommandLineOptionsT<CharType>::SnapshotReader::Acquire()
+{
+    auto impl = slot_->impl_;
+    slot_->epoch_.store(impl->epoch_.load());
+    return impl->snapshot_.load();
+}
+
+template<typename CharType>
+void CommandLineOptionsT<CharType>::SnapshotReader::Release()
+{
+    slot_->epoch_.store(0, std::memory_order_release);
+}
+#endif
+
+template<typename CharType>
+void CommandLineOptionsT<CharType>::AddUsageNewLine()
+{
+    impl_->AddOption(nullptr, nullptr, nullptr, nullptr, Impl::Option::NEWLINE, true);
+}
+
+template<typename CharType>
+void CommandLineOptionsT<CharType>::AddUsageSection(CharT const* title)
+{
+    impl_->AddOption(nullptr, nullptr, title, nullptr, Impl::Option::SECTION, true);
+}
+
+template<typename CharType>
+void CommandLineOptionsT<CharType>::AddSubcommand(CharT const* name, CharT const* description, SubcommandFactory factory, void* context)
+{
+    impl_->subcommands_.emplace_back(typename Impl::Subcommand{ name, description, factory, context });
+}
+
+template<typename CharType>
+CommandLineOptionsT<CharType>* CommandLineOptionsT<CharType>::GetSubcommand() const
+{
+    return impl_->subcommand_.get();
+}
+
+template<typename CharType>
+typename CommandLineOptionsT<CharType>::CharT const* CommandLineOptionsT<CharType>::GetSubcommandName() const
+{
+    return impl_->subcommand_ == nullptr ? nullptr : impl_->subcommand_->impl_->subcommandName_;
+}
+
+template<typename CharType>
+size_t CommandLineOptionsT<CharType>::Impl::GetColumnWidth() const
+{
+    size_t colWidth = 0;
+    for (auto const& opt : options_) {
+        if (opt.name_ != nullptr && opt.type_ != Option::ARG) {
+            colWidth = std::max(colWidth, (opt.name_      == nullptr ? 0 : Traits::Length(opt.name_)) +
+                                          (opt.valueDesc_ == nullptr ? 0 : Traits::Length(opt.valueDesc_) + 1));
+        }
+    }
+    if (hasShortNames_) {
+        // Room for "-c, " before the name.
+        colWidth += 4;
+    }
+    for (auto const& sub : subcommands_) {
+        // Subcommands are listed without the "--" of option names.
+        auto n = Traits::Length(sub.name_);
+        colWidth = std::max(colWidth, n < 2 ? 0 : n - 2);
+    }
+    return colWidth + 8;
+}
+
+template<typename CharType>
+void CommandLineOptionsT<CharType>::Impl::PrintDescription(FILE* fp, int x, size_t colWidth, int targetWidth, CharT const* description)
+{
+    x += Traits::Print(fp, (CharT) ' ');
+    for (; x < (int) colWidth; ++x) {
+        Traits::Print(fp, (CharT) ' ');
+    }
+    for (auto p = description; *p; ++p) {
+        if (x > targetWidth && *p == ' ') {
+            x = (int) colWidth;
+            Traits::Print(fp, (CharT) '\n');
+            for (int i = 0; i < x; ++i) {
+                Traits::Print(fp, (CharT) ' ');
+            }
+        } else {
+            x += Traits::Print(fp, *p);
+        }
+    }
+}
+
+// Compares words by their folded characters, where a shorter word orders
+// first.
+template<typename CharType>
+int CommandLineOptionsT<CharType>::Impl::CompareWords(CharT const* a, size_t an, CharT const* b, size_t bn)
+{
+    for (size_t i = 0; i < an && i < bn; ++i) {
+        auto ca = Traits::FoldCase(a[i]);
+        auto cb = Traits::FoldCase(b[i]);
+        if (ca != cb) {
+            return ca < cb ? -1 : 1;
+        }
+    }
+    return an == bn ? 0 : an < bn ? -1 : 1;
+}
+
+template<typename CharType>
+void CommandLineOptionsT<CharType>::Impl::BuildHelpIndex()
+{
+    if (!helpIndexDirty_) {
+        return;
+    }
+    helpIndexDirty_ = false;
+
+    helpIndex_.clear();
+    auto AddWords = [this](CharT const* text, uint32_t option) {
+        for (auto p = text; *p != '\0'; ) {
+            if (!IsWordChar(*p)) {
+                ++p;
+                continue;
+            }
+            auto word = p;
+            while (IsWordChar(*p)) {
+                ++p;
+            }
+            helpIndex_.emplace_back(HelpWord{ word, (uint32_t) (p - word), option });
+        }
+    };
+
+    CharT const* section = nullptr;
+    for (uint32_t i = 0, n = (uint32_t) options_.size(); i < n; ++i) {
+        auto const& opt = options_[i];
+        if (opt.type_ == Option::SECTION) {
+            section = opt.description_;
+        }
+        if (opt.name_ == nullptr || !opt.includeInUsage_) {
+            continue;
+        }
+        AddWords(opt.name_, i);
+        if (opt.description_ != nullptr) {
+            AddWords(opt.description_, i);
+        }
+        if (section != nullptr) {
+            AddWords(section, i);
+        }
+    }
+
+    std::sort(helpIndex_.begin(), helpIndex_.end(), [](HelpWord const& a, HelpWord const& b) {
+        int c = CompareWords(a.word_, a.length_, b.word_, b.length_);
+        return c < 0 || (c == 0 && a.option_ < b.option_);
+    });
+}
+
+// Returns a bitset over options_ of the options that match term.
+template<typename CharType>
+std::vector<uint64_t> CommandLineOptionsT<CharType>::Impl::Search(CharT const* term)
+{
+    BuildHelpIndex();
+
+    std::vector<uint64_t> matches;
+    std::vector<uint64_t> wordMatches((options_.size() + 63) / 64);
+    for (auto p = term; *p != '\0'; ) {
+        if (!IsWordChar(*p)) {
+            ++p;
+            continue;
+        }
+        auto word = p;
+        while (IsWordChar(*p)) {
+            ++p;
+        }
+        auto n = (size_t) (p - word);
+
+        // The index words that word is a prefix of are adjacent.
+        std::fill(wordMatches.begin(), wordMatches.end(), 0);
+        auto it = std::lower_bound(helpIndex_.begin(), helpIndex_.end(), 0, [word, n](HelpWord const& w, int) {
+            return CompareWords(w.word_, w.length_, word, n) < 0;
+        });
+        for (; it != helpIndex_.end() && it->length_ >= n && CompareWords(it->word_, n, word, n) == 0; ++it) {
+            wordMatches[it->option_ / 64] |= 1ull << (it->option_ % 64);
+        }
+
+        if (matches.empty()) {
+            matches = wordMatches;
+        } else {
+            for (size_t w = 0; w < matches.size(); ++w) {
+                matches[w] &= wordMatches[w];
+            }
+        }
+    }
+    if (matches.empty()) {
+        matches.assign(wordMatches.size(), 0);
+    }
+    return matches;
+}
+
+template<typename CharType>
+void CommandLineOptionsT<CharType>::Impl::PrintOptions(FILE* fp, size_t colWidth, int targetWidth, std::vector<uint64_t> const* filter) const
+{
+    // When filtering, a section's title is only printed before its first
+    // matching option, and blank lines are left out.
+    Option const* section = nullptr;
+    for (auto const& opt : options_) {
+        if (opt.type_ == Option::SECTION) {
+            section = &opt;
+            if (filter == nullptr) {
+                Traits::Print(fp, (CharT) '\n');
+                Traits::Print(fp, opt.description_);
+                Traits::PrintNarrow(fp, ":\n");
+            }
+            continue;
+        }
+        if (filter != nullptr) {
+            if (opt.type_ == Option::NEWLINE || !TestBit(*filter, GetIndex(&opt))) {
+                continue;
+            }
+            if (section != nullptr) {
+                Traits::Print(fp, section->description_);
+                Traits::PrintNarrow(fp, ":\n");
+                section = nullptr;
+            }
+        }
+        if (opt.includeInUsage_) {
+            int x = 0;
+            if (opt.name_ != nullptr) {
+                x += Traits::PrintNarrow(fp, "    ");
+                if (opt.shortName_ != 0) {
+                    x += Traits::Print(fp, (CharT) '-');
+                    x += Traits::Print(fp, opt.shortName_);
+                    x += Traits::PrintNarrow(fp, ", ");
+                } else if (hasShortNames_) {
+                    x += Traits::PrintNarrow(fp, "    ");
+                }
+                x += Traits::PrintNarrow(fp, "--");
+                x += Traits::Print(fp, opt.name_);
+            }
+            if (opt.valueDesc_ != nullptr) {
+                x += Traits::Print(fp, (CharT) '=');
+                x += Traits::Print(fp, opt.valueDesc_);
+            }
+            if (opt.description_ != nullptr) {
+                PrintDescription(fp, x, colWidth, targetWidth, opt.description_);
+            }
+            Traits::Print(fp, (CharT) '\n');
+        }
+    }
+}
+
+template<typename CharType>
+void CommandLineOptionsT<CharType>::PrintUsage(FILE* fp, int targetWidth) const
+{
+    PrintUsage(fp, impl_->helpTerm_, targetWidth);
+}
+
+template<typename CharType>
+void CommandLineOptionsT<CharType>::PrintUsage(FILE* fp, CharT const* term, int targetWidth) const
+{
+    using Option = typename Impl::Option;
+
+    // Scan options to determine option width, etc.
+    bool hasOptions = false;
+    for (auto const& opt : impl_->options_) {
+        if (opt.name_ != nullptr && opt.type_ != Option::ARG) {
+            hasOptions = true;
+        }
+    }
+    auto colWidth = impl_->GetColumnWidth();
+    for (auto parent = impl_->parent_; parent != nullptr; parent = parent->parent_) {
+        colWidth = std::max(colWidth, parent->GetColumnWidth());
+    }
+
+    // usage: exe [options] arg arg ...
+    Traits::PrintNarrow(fp, "usage: ");
+    impl_->PrintProgramName(fp);
+    if (hasOptions) {
+        Traits::PrintNarrow(fp, " [options]");
+    }
+    for (auto const& opt : impl_->options_) {
+        if (opt.type_ == Option::ARG) {
+            Traits::Print(fp, (CharT) ' ');
+            Traits::Print(fp, opt.name_);
+        }
+    }
+    if (!impl_->subcommands_.empty()) {
+        Traits::PrintNarrow(fp, " <command> [command options]");
+    }
+    Traits::PrintNarrow(fp, "\n");
+
+    // options matching "term":
+    //     --name=value    desc...
+    if (term != nullptr) {
+        bool found = false;
+        for (auto impl = impl_; impl != nullptr; impl = impl->parent_) {
+            auto matches = impl->Search(term);
+            if (std::any_of(matches.begin(), matches.end(), [](uint64_t w) { return w != 0; })) {
+                Traits::PrintNarrow(fp, impl == impl_ ? "options matching \"" : "global options matching \"");
+                Traits::Print(fp, term);
+                Traits::PrintNarrow(fp, "\":\n");
+                impl->PrintOptions(fp, colWidth, targetWidth, &matches);
+                found = true;
+            }
+        }
+        if (!found) {
+            Traits::PrintNarrow(fp, "no options match \"");
+            Traits::Print(fp, term);
+            Traits::PrintNarrow(fp, "\".\n");
+        }
+        return;
+    }
+
+    // options:
+    //     --name=value    desc...
+    if (hasOptions) {
+        Traits::PrintNarrow(fp, "options:\n");
+        impl_->PrintOptions(fp, colWidth, targetWidth, nullptr);
+    }
+
+    // commands:
+    //     name            desc...
+    if (!impl_->subcommands_.empty()) {
+        Traits::PrintNarrow(fp, "commands:\n");
+        for (auto const& sub : impl_->subcommands_) {
+            int x = Traits::PrintNarrow(fp, "    ");
+            x += Traits::Print(fp, sub.name_);
+            if (sub.description_ != nullptr) {
+                Impl::PrintDescription(fp, x, colWidth, targetWidth, sub.description_);
+            }
+            Traits::Print(fp, (CharT) '\n');
+        }
+    }
+
+    // global options:
+    //     --name=value    desc...
+    for (auto parent = impl_->parent_; parent != nullptr; parent = parent->parent_) {
+        if (!parent->options_.empty()) {
+            Traits::PrintNarrow(fp, "global options:\n");
+            parent->PrintOptions(fp, colWidth, targetWidth, nullptr);
+        }
+    }
+}
+
+template<typename CharType>
+CommandLineOptionsResult CommandLineOptionsT<CharType>::Parse(int argc, CharT** argv, int* errorArgIndex)
+{
+    return impl_->Parse(argc, argv, errorArgIndex);
+}
+
+template<typename CharType>
+CommandLineOptionsResult CommandLineOptionsT<CharType>::Parse(int argc, CharT** argv, CommandLineOptionsError* errors, uint32_t capacity, uint32_t* errorCount)
+{
+    impl_->BeginParse(argc, argv);
+    typename Impl::ErrorSink sink{ nullptr, errors, capacity, 0, CommandLineOptions_Ok };
+    auto result = impl_->ParseArguments(argc, argv, 1, &sink);
+    if (result != CommandLineOptions_HelpRequested) {
+        impl_->CheckConstraints(&sink, nullptr);
+        result = sink.result_;
+    }
+    if (errorCount != nullptr) {
+        *errorCount = sink.count_;
+    }
+    return result;
+}
+
+template<typename CharType>
+CommandLineOptionsResult CommandLineOptionsT<CharType>::Impl::Parse(int argc, CharT** argv, int* errorArgIndex)
+{
+    BeginParse(argc, argv);
+    ErrorSink sink{ errorArgIndex, nullptr, 0, 0, CommandLineOptions_Ok };
+    auto result = ParseArguments(argc, argv, 1, &sink);
+    if (result == CommandLineOptions_Ok && !deferConstraints_) {
+        CheckConstraints(&sink, nullptr);
+        result = sink.result_;
+    }
+    return result;
+}
+
+// Aligns offset for a value of size bytes: to the largest power of two that
+// the size allows, up to 16.
+template<typename CharType>
+uint32_t CommandLineOptionsT<CharType>::Impl::AlignValue(uint32_t offset, uint32_t size)
+{
+    uint32_t align = size >= 16 ? 16 : size >= 8 ? 8 : size >= 4 ? 4 : size >= 2 ? 2 : 1;
+    return (offset + align - 1) & ~(align - 1);
+}
+
+// Lays out a copy of every option's value, each aligned to the largest power
+// of two that its size allows (up to 16), as offset and size pairs.  Returns
+// the total size.
+template<typename CharType>
+uint32_t CommandLineOptionsT<CharType>::Impl::LayoutValues(std::vector<uint32_t>* layout) const
+{
+    layout->assign(2 * options_.size(), 0);
+    uint32_t total = 0;
+    for (size_t i = 0, n = options_.size(); i < n; ++i) {
+        uint32_t size = options_[i].valueSize_;
+        total = AlignValue(total, size);
+        (*layout)[2 * i] = total;
+        (*layout)[2 * i + 1] = size;
+        total += size;
+    }
+    return total;
+}
+
+// Copies an option's value to a plain buffer of valueSize_ bytes.
+template<typename CharType>
+void CommandLineOptionsT<CharType>::Impl::LoadValue(Option const& opt, void* copy)
+{
+#if CLOVER_ENABLE_RUNTIME
+    if (opt.loadLive_ != nullptr) {
+        opt.loadLive_(opt.value_, copy);
+        return;
+    }
+#endif
+    if (opt.valueSize_ != 0) {
+        memcpy(copy, opt.value_, opt.valueSize_);
+    }
+}
+
+// Stores a plain copy of a value (see LoadValue()) in an option.
+template<typename CharType>
+void CommandLineOptionsT<CharType>::Impl::StoreValue(Option const& opt, void const* value)
+{
+#if CLOVER_ENABLE_RUNTIME
+    if (opt.storeLive_ != nullptr) {
+        opt.storeLive_(opt.value_, (void*) value);
+        return;
+    }
+#endif
+    memcpy(opt.value_, value, opt.valueSize_);
+}
+
+template<typename CharType>
+CommandLineOptionsResult CommandLineOptionsT<CharType>::ParseCached(char const* cacheDir, int argc, CharT** argv, int* errorArgIndex)
+{
+    return impl_->ParseCached(cacheDir, argc, argv, errorArgIndex);
+}
+
+// A word at a time variant of 64-bit FNV-1a, continuing from h.
+template<typename CharType>
+uint64_t CommandLineOptionsT<CharType>::Impl::HashBytes(uint64_t h, void const* data, size_t size)
+{
+    auto p = (unsigned char const*) data;
+    for (; size >= sizeof(uint64_t); p += sizeof(uint64_t), size -= sizeof(uint64_t)) {
+        uint64_t word;
+        memcpy(&word, p, sizeof(word));
+        h = (h ^ word) * 1099511628211ull;
+        h ^= h >> 32;
+    }
+    for (; size > 0; ++p, --size) {
+        h = (h ^ *p) * 1099511628211ull;
+    }
+    return h;
+}
+
+// Hashes everything that decides what arguments match and how their values
+// are stored, including the names of the value types, so that a cache
+// written for a type of the same size isn't read into another.
+template<typename CharType>
+uint64_t CommandLineOptionsT<CharType>::Impl::HashSchema() const
+{
+    auto h = HashBytes(14695981039346656037ull, &parseFlags_, sizeof(parseFlags_));
+    for (auto const& opt : options_) {
+        uint32_t properties[] = {
+            (uint32_t) opt.type_, opt.valueSize_, (uint32_t) opt.shortName_, IsString(opt), opt.valueDesc_ != nullptr, opt.choiceCount_,
+        };
+        h = HashBytes(h, properties, sizeof(properties));
+        if (opt.typeName_ != nullptr) {
+            auto typeName = opt.typeName_();
+            h = HashBytes(h, typeName, strlen(typeName));
+        }
+        h = HashBytes(h, opt.name_, opt.nameLength_ * sizeof(CharT));
+        for (uint32_t c = 0; c < opt.choiceCount_; ++c) {
+            h = HashBytes(h, opt.choices_[c], (Traits::Length(opt.choices_[c]) + 1) * sizeof(CharT));
+        }
+    }
+    for (auto const& sub : subcommands_) {
+        h = HashBytes(h, sub.name_, (Traits::Length(sub.name_) + 1) * sizeof(CharT));
+    }
+    return h;
+}
+
+// Whether an option's value points at its text.
+template<typename CharType>
+bool CommandLineOptionsT<CharType>::Impl::IsString(Option const& opt)
+{
+    return opt.type_ == Option::ARG || opt.convert_ == &Convert<CharT*> || opt.convert_ == &Convert<CharT const*> ||
+           opt.convert_ == &Convert<std::basic_string_view<CharT>>;
+}
+
+template<typename CharType>
+CommandLineOptionsResult CommandLineOptionsT<CharType>::Impl::ParseCached(char const* cacheDir, int argc, CharT** argv, int* errorArgIndex)
+{
+    BeginParse(argc, argv);
+
+    CacheHeader header;
+    memset(&header, 0, sizeof(header));
+    header.magic_ = CacheHeader::kMagic;
+    header.layoutVersion_ = CacheHeader::kLayoutVersion;
+    header.charSize_ = (uint32_t) sizeof(CharT);
+    header.argCount_ = argc > 1 ? (uint32_t) argc - 1 : 0;
+    header.optionCount_ = (uint32_t) options_.size();
+
+    std::vector<size_t> lengths(header.argCount_);
+    auto h = HashBytes(14695981039346656037ull, &header.argCount_, sizeof(header.argCount_));
+    size_t textSize = 0;
+    for (uint32_t i = 0; i < header.argCount_; ++i) {
+        lengths[i] = Traits::Length(argv[i + 1]);
+        h = HashBytes(h, argv[i + 1], (lengths[i] + 1) * sizeof(CharT));
+        textSize += (lengths[i] + 1) * sizeof(CharT);
+    }
+    header.argHash_ = h;
+    header.schemaHash_ = HashSchema();
+    header.textSize_ = (uint32_t) textSize;
+
+    char name[64];
+    snprintf(name, sizeof(name), "/clover-%016llx%016llx.cache", (unsigned long long) header.argHash_, (unsigned long long) header.schemaHash_);
+    auto path = std::string(cacheDir) + name;
+
+    Mapping mapping;
+    if (textSize <= UINT32_MAX / 2 && MapFile(path.c_str(), &mapping)) {
+        bool hit = ApplyCache(mapping, argv, lengths, header);
+        UnmapFile(mapping);
+        if (hit) {
+            ErrorSink sink{ errorArgIndex, nullptr, 0, 0, CommandLineOptions_Ok };
+            if (!deferConstraints_) {
+                CheckConstraints(&sink, nullptr);
+            }
+            return sink.result_;
+        }
+    }
+
+    auto result = Parse(argc, argv, errorArgIndex);
+    if (result == CommandLineOptions_Ok && textSize <= UINT32_MAX / 2) {
+        WriteCache(path, argv, lengths, header);
+    }
+    return result;
+}
+
+// Sets the options from a cache file, if it matches the arguments and the
+// options in expected, after checking every offset in it.
+template<typename CharType>
+bool CommandLineOptionsT<CharType>::Impl::ApplyCache(Mapping const& mapping, CharT** argv, std::vector<size_t> const& lengths, CacheHeader const& expected)
+{
+    auto data = (unsigned char const*) mapping.address_;
+    auto size = mapping.size_;
+    if (data == nullptr || size < sizeof(CacheHeader)) {
+        return false;
+    }
+    CacheHeader header;
+    memcpy(&header, data, sizeof(header));
+    auto optionCount = (size_t) expected.optionCount_;
+    auto words = (optionCount + 63) / 64;
+    if (header.magic_ != expected.magic_ || header.layoutVersion_ != expected.layoutVersion_ ||
+        header.argHash_ != expected.argHash_ || header.schemaHash_ != expected.schemaHash_ ||
+        header.charSize_ != expected.charSize_ || header.argCount_ != expected.argCount_ ||
+        header.optionCount_ != expected.optionCount_ || header.textSize_ != expected.textSize_ || header.size_ != size ||
+        header.textOffset_ % sizeof(CharT) != 0 || (size_t) header.textOffset_ + header.textSize_ > size ||
+        header.indicesOffset_ % sizeof(int32_t) != 0 || header.indicesOffset_ + optionCount * sizeof(int32_t) > size ||
+        header.foundOffset_ % sizeof(uint64_t) != 0 || header.foundOffset_ + words * sizeof(uint64_t) > size ||
+        header.valuesOffset_ % 16 != 0 || header.valuesOffset_ > size) {
+        return false;
+    }
+
+    // The hashes only pick the file; the arguments have to be the same.
+    auto text = data + header.textOffset_;
+    for (uint32_t i = 0; i < header.argCount_; ++i) {
+        auto n = (lengths[i] + 1) * sizeof(CharT);
+        if (memcmp(text, argv[i + 1], n) != 0) {
+            return false;
+        }
+        text += n;
+    }
+
+    // Check every found option's value before setting any.
+    auto indices = (int32_t const*) (data + header.indicesOffset_);
+    auto found = (uint64_t const*) (data + header.foundOffset_);
+    auto Found = [found](size_t i) { return ((found[i / 64] >> (i % 64)) & 1) != 0; };
+    size_t offset = header.valuesOffset_;
+    for (size_t i = 0; i < optionCount; ++i) {
+        if (!Found(i)) {
+            continue;
+        }
+        auto const& opt = options_[i];
+        uint32_t cachedSize = GetCachedSize(opt);
+        uint32_t align = cachedSize >= 16 ? 16 : cachedSize >= 8 ? 8 : cachedSize >= 4 ? 4 : cachedSize >= 2 ? 2 : 1;
+        offset = (offset + align - 1) & ~(size_t) (align - 1);
+        if (opt.type_ == Option::ACTION || cachedSize == 0 || offset + cachedSize > size ||
+            indices[i] < 1 || indices[i] > (int32_t) header.argCount_) {
+            return false;
+        }
+        if (IsString(opt)) {
+            CachedString s;
+            memcpy(&s, data + offset, sizeof(s));
+            if (s.arg_ >= header.argCount_ || (size_t) s.offset_ + s.length_ > lengths[s.arg_]) {
+                return false;
+            }
+        }
+        offset += cachedSize;
+    }
+
+    offset = header.valuesOffset_;
+    for (size_t i = 0; i < optionCount; ++i) {
+        if (!Found(i)) {
+            continue;
+        }
+        auto const& opt = options_[i];
+        uint32_t cachedSize = GetCachedSize(opt);
+        uint32_t align = cachedSize >= 16 ? 16 : cachedSize >= 8 ? 8 : cachedSize >= 4 ? 4 : cachedSize >= 2 ? 2 : 1;
+        offset = (offset + align - 1) & ~(size_t) (align - 1);
+        if (IsString(opt)) {
+            CachedString s;
+            memcpy(&s, data + offset, sizeof(s));
+            auto valueText = argv[s.arg_ + 1] + s.offset_;
+            if (opt.type_ == Option::VALUE && opt.convert_ == &Convert<std::basic_string_view<CharT>>) {
+                *(std::basic_string_view<CharT>*) opt.value_ = std::basic_string_view<CharT>(valueText, s.length_);
+            } else {
+                *(CharT**) opt.value_ = valueText;
+            }
+        } else {
+            StoreValue(opt, data + offset);
+        }
+        MarkFound(&opt, indices[i]);
+        offset += cachedSize;
+    }
+    return true;
+}
+
+// Writes the result of a successful Parse() to a cache file, unless it can't
+// be stored (see PARSE CACHE above).
+template<typename CharType>
+void CommandLineOptionsT<CharType>::Impl::WriteCache(std::string const& path, CharT** argv, std::vector<size_t> const& lengths, CacheHeader header) const
+{
+    if (subcommand_ != nullptr) {
+        return;
+    }
+    auto optionCount = (size_t) options_.size();
+    auto words = (optionCount + 63) / 64;
+    auto const& found = setBits_[CommandLineOptions_SourceCommandLine];
+    header.textOffset_ = (uint32_t) sizeof(CacheHeader);
+    header.indicesOffset_ = (header.textOffset_ + header.textSize_ + 3) & ~3u;
+    header.foundOffset_ = (uint32_t) ((header.indicesOffset_ + optionCount * sizeof(int32_t) + 7) & ~(size_t) 7);
+    header.valuesOffset_ = (uint32_t) ((header.foundOffset_ + words * sizeof(uint64_t) + 15) & ~(size_t) 15);
+
+    std::vector<unsigned char> image(header.valuesOffset_);
+    auto text = image.data() + header.textOffset_;
+    for (uint32_t i = 0; i < header.argCount_; ++i) {
+        memcpy(text, argv[i + 1], (lengths[i] + 1) * sizeof(CharT));
+        text += (lengths[i] + 1) * sizeof(CharT);
+    }
+    for (size_t i = 0; i < optionCount; ++i) {
+        int32_t index = argIndices_[i];
+        memcpy(image.data() + header.indicesOffset_ + i * sizeof(int32_t), &index, sizeof(index));
+    }
+    memcpy(image.data() + header.foundOffset_, found.data(), words * sizeof(uint64_t));
+
+    for (size_t i = 0; i < optionCount; ++i) {
+        if (!TestBit(found, (uint32_t) i)) {
+            continue;
+        }
+        auto const& opt = options_[i];
+        uint32_t cachedSize = GetCachedSize(opt);
+        if (opt.type_ == Option::ACTION || cachedSize == 0) {
+            return;
+        }
+        uint32_t align = cachedSize >= 16 ? 16 : cachedSize >= 8 ? 8 : cachedSize >= 4 ? 4 : cachedSize >= 2 ? 2 : 1;
+        auto offset = (image.size() + align - 1) & ~(size_t) (align - 1);
+        image.resize(offset + cachedSize, 0);
+        if (!IsString(opt)) {
+            LoadValue(opt, image.data() + offset);
+            continue;
+        }
+
+        // Find the argument the string points into: the one that set the
+        // option, or the next, which a short option's value may be.
+        std::basic_string_view<CharT> value;
+        if (opt.type_ == Option::VALUE && opt.convert_ == &Convert<std::basic_string_view<CharT>>) {
+            value = *(std::basic_string_view<CharT> const*) opt.value_;
+        } else if (auto p = *(CharT const* const*) opt.value_) {
+            value = p;
+        }
+        bool stored = false;
+        for (int a = argIndices_[i]; a <= argIndices_[i] + 1 && a <= (int) header.argCount_ && !stored; ++a) {
+            if (a < 1 || value.data() < argv[a] || value.data() + value.size() > argv[a] + lengths[a - 1]) {
+                continue;
+            }
+            CachedString s{ (uint32_t) a - 1, (uint32_t) (value.data() - argv[a]), (uint32_t) value.size() };
+            memcpy(image.data() + offset, &s, sizeof(s));
+            stored = true;
+        }
+        if (!stored) {
+            return;
+        }
+    }
+    header.size_ = (uint32_t) image.size();
+    memcpy(image.data(), &header, sizeof(header));
+
+    // Write a file of this process's own, and rename it into place.
+#ifdef _WIN32
+    auto tmpPath = path + "." + std::to_string(GetCurrentProcessId()) + ".tmp";
+#else
+    auto tmpPath = path + "." + std::to_string(getpid()) + ".tmp";
+#endif
+    FILE* fp = fopen(tmpPath.c_str(), "wb");
+    if (fp == nullptr) {
+        return;
+    }
+    bool written = fwrite(image.data(), 1, image.size(), fp) == image.size();
+    written &= fclose(fp) == 0;
+#ifdef _WIN32
+    written = written && MoveFileExA(tmpPath.c_str(), path.c_str(), MOVEFILE_REPLACE_EXISTING) != 0;
+#else
+    written = written && rename(tmpPath.c_str(), path.c_str()) == 0;
+#endif
+    if (!written) {
+        remove(tmpPath.c_str());
+    }
+}
+
+// Undoes the last command line and resets the results of the last Parse(),
+// and answers a shell completion request (see SHELL COMPLETION above).
+template<typename CharType>
+void CommandLineOptionsT<CharType>::Impl::BeginParse(int argc, CharT** argv)
+{
+    ResetCommandLine();
+    ResetResults(argc, argv);
+
+    static char const kComplete[] = "--clover-complete=";
+    if (argc > 1) {
+        auto arg = argv[1];
+        size_t n = 0;
+        while (n < sizeof(kComplete) - 1 && arg[n] == (CharT) kComplete[n]) {
+            ++n;
+        }
+        int64_t index = 0;
+        if (n == sizeof(kComplete) - 1 && Traits::ParseInt64(arg + n, &index) && index >= 0) {
+            Complete(stdout, argv + 2, argc - 2, (int) std::min(index, (int64_t) argc - 2));
+            fflush(stdout);
+            exit(0);
+        }
+    }
+}
+
+template<typename CharType>
+void CommandLineOptionsT<CharType>::Impl::ResetResults(int argc, CharT** argv)
+{
+    programName_ = argc > 0 ? argv[0] : nullptr;
+    subcommand_.reset();
+    ambiguous_.clear();
+    helpTerm_ = nullptr;
+    argIndices_.assign(options_.size(), -1);
+    violated_.clear();
+}
+
+// Records the values that the command line is about to override: those of
+// options added since the last call, and those that a lower priority source
+// set since.  Lower sources can't change an option the command line set, so
+// its recorded value is still the one beneath it.
+template<typename CharType>
+void CommandLineOptionsT<CharType>::Impl::RecordDefaults()
+{
+    auto first = (uint32_t) defaultOffsets_.size();
+    for (auto i = first, n = (uint32_t) options_.size(); i < n; ++i) {
+        auto size = options_[i].valueSize_;
+        auto offset = AlignValue(defaultsSize_, size);
+        defaultsSize_ = offset + size;
+        defaults_.resize(defaultsSize_ / sizeof(max_align_t) + 1);
+        defaultOffsets_.emplace_back(offset);
+        LoadValue(options_[i], (unsigned char*) defaults_.data() + offset);
+    }
+
+    auto const& commandLineBits = setBits_[CommandLineOptions_SourceCommandLine];
+    auto defaults = (unsigned char*) defaults_.data();
+    for (uint32_t i = 0; i < first; ++i) {
+        if (!TestBit(commandLineBits, i) && IsSetBelowCommandLine(i)) {
+            LoadValue(options_[i], defaults + defaultOffsets_[i]);
+        }
+    }
+}
+
+// Makes the next command line start from the options' values below the
+// command line: the options that the last one set get back the values
+// recorded for them, and none are found by it any more.  Values that can't
+// be copied (see OPTION TYPES above) keep the last command line's.
+template<typename CharType>
+void CommandLineOptionsT<CharType>::Impl::ResetCommandLine()
+{
+    RecordDefaults();
+    auto& commandLineBits = setBits_[CommandLineOptions_SourceCommandLine];
+    auto defaults = (unsigned char const*) defaults_.data();
+    for (uint32_t i = 0, n = (uint32_t) options_.size(); i < n; ++i) {
+        auto const& opt = options_[i];
+        if (TestBit(commandLineBits, i) && opt.valueSize_ != 0) {
+            StoreValue(opt, defaults + defaultOffsets_[i]);
+        }
+    }
+    std::fill(commandLineBits.begin(), commandLineBits.end(), 0);
+}
+
+template<typename CharType>
+CommandLineOptionsResult CommandLineOptionsT<CharType>::Impl::ParseArguments(int argc, CharT** argv, int argIndex, ErrorSink* sink)
+{
+    // The command line is the highest priority source, so nothing is blocked.
+    auto const& commandLineBits = setBits_[CommandLineOptions_SourceCommandLine];
+
+    // Reports an error caused by the current argument, and returns whether
+    // to stop parsing.
+    auto Error = [&argIndex, sink](CommandLineOptionsResult result, CommandLineOptionHandle option) {
+        return sink->Report(result, argIndex, option);
+    };
+    auto const none = CommandLineOptionHandle::Invalid;
+
+    for ( ; argIndex < argc; ++argIndex) {
+        auto arg = argv[argIndex];
+
+        bool hasPrefix = true;
+        bool isShort = false;
+        if (*arg == '/') {
+            ++arg;
         } else if (*arg == '-') {
             ++arg;
             if (*arg == '-') {
                 ++arg;
+            } else {
+                isShort = true;
+            }
+        } else {
+            hasPrefix = false;
+        }
+
+        if (hasPrefix && (EqualIgnoreCase(arg, "?") ||
+                          EqualIgnoreCase(arg, "h") ||
+                          EqualIgnoreCase(arg, "help"))) {
+            Error(CommandLineOptions_HelpRequested, none);
+            return sink->result_;
+        }
+        if (hasPrefix && Traits::FoldCase(arg[0]) == 'h' && Traits::FoldCase(arg[1]) == 'e' &&
+                         Traits::FoldCase(arg[2]) == 'l' && Traits::FoldCase(arg[3]) == 'p' && arg[4] == '=') {
+            helpTerm_ = arg[5] == '\0' ? nullptr : arg + 5;
+            Error(CommandLineOptions_HelpRequested, none);
+            return sink->result_;
+        }
+
+        if (!hasPrefix) {
+            // Hand the rest of the arguments to a subcommand.
+            for (auto const& sub : subcommands_) {
+                if (EqualIgnoreCase(arg, sub.name_)) {
+                    subcommand_.reset(new CommandLineOptionsT);
+                    auto subImpl = subcommand_->impl_;
+                    subImpl->parent_ = this;
+                    subImpl->subcommandName_ = sub.name_;
+                    subImpl->parseFlags_ = parseFlags_;
+                    sub.factory_(subcommand_.get(), sub.context_);
+                    return subImpl->ParseArguments(argc, argv, argIndex + 1, sink);
+                }
+            }
+
+            Option* match = nullptr;
+            for (auto& opt : options_) {
+                if (opt.type_ == Option::ARG && !TestBit(commandLineBits, GetIndex(&opt))) {
+                    match = &opt;
+                    break;
+                }
+            }
+            if (match == nullptr) {
+                if (Error(CommandLineOptions_ErrorUnrecognisedArgument, none)) {
+                    return sink->result_;
+                }
+                continue;
             }
-        } else {
-            hasPrefix = false;
+            *((CharT**) match->value_) = arg;
+            MarkFound(match, argIndex);
+            continue;
         }
 
-        if (hasPrefix && (CLOVER_stricmp(arg, CLOVER_MAKESTR("?")) ||
-                          CLOVER_stricmp(arg, CLOVER_MAKESTR("h")) ||
-                          CLOVER_stricmp(arg, CLOVER_MAKESTR("help")))) {
-            return Error(CommandLineOptions_HelpRequested);
+        auto value = arg;
+        while (*value != '\0' && *value != '=') {
+            ++value;
         }
 
-        bool found = false;
-        for (auto& opt : options_) {
-            if (opt.type_ == Option::ARG) {
-                if (!hasPrefix && opt.found_ == false) {
-                    *((CharT**) opt.value_) = arg;
-                    opt.found_ = true;
-                    found = true;
-                    break;
+        Impl* owner = nullptr;
+        auto opt = FindOptionInScope(arg, (size_t) (value - arg), &owner);
+        if (opt == nullptr && isShort && FindShortOptionInScope(*arg, &owner) != nullptr) {
+            auto failed = none;
+            auto result = ParseShortOptions(arg, argc, argv, &argIndex, &failed);
+            if (result != CommandLineOptions_Ok && Error(result, failed)) {
+                return sink->result_;
+            }
+            continue;
+        }
+        if (opt == nullptr && value != arg) {
+            bool ambiguous = false;
+            opt = FindAbbreviationInScope(arg, (size_t) (value - arg), &owner, &ambiguous);
+            if (ambiguous) {
+                if (Error(CommandLineOptions_ErrorAmbiguousArgument, none)) {
+                    return sink->result_;
                 }
+                continue;
+            }
+        }
+        if (opt == nullptr) {
+            if (Error(CommandLineOptions_ErrorUnrecognisedArgument, none)) {
+                return sink->result_;
             }
+            continue;
+        }
 
-            else if (opt.type_ == Option::BOOL) {
-                if (hasPrefix && CLOVER_stricmp(arg, opt.name_)) {
-                    *((bool*) opt.value_) = true;
-                    opt.found_ = true;
-                    found = true;
-                    break;
-                }
+        auto result = CommandLineOptions_Ok;
+        if (IsFlag(*opt)) {
+            result = *value != '\0' ? CommandLineOptions_ErrorUnrecognisedArgument : SetFlag(opt);
+        } else {
+            result = *value == '\0' ? CommandLineOptions_ErrorArgumentExpectingValue : SetValue(opt, value + 1);
+        }
+        if (result != CommandLineOptions_Ok) {
+            if (Error(result, (CommandLineOptionHandle) owner->GetIndex(opt))) {
+                return sink->result_;
+            }
+            continue;
+        }
+        owner->MarkFound(opt, argIndex);
+    }
+
+    return sink->result_;
+}
+
+// Parses a cluster of short options (e.g., "vj8" from "-vj8").  If the last one
+// takes its value from the next argument, *argIndex is advanced to it.  On an
+// error, *failed is set to the option that caused it, if any.
+template<typename CharType>
+CommandLineOptionsResult CommandLineOptionsT<CharType>::Impl::ParseShortOptions(CharT* arg, int argc, CharT** argv, int* argIndex, CommandLineOptionHandle* failed)
+{
+    auto clusterIndex = *argIndex;
+    for (auto p = arg; *p != '\0'; ++p) {
+        Impl* owner = nullptr;
+        auto opt = FindShortOptionInScope(*p, &owner);
+        if (opt == nullptr) {
+            *failed = CommandLineOptionHandle::Invalid;
+            return CommandLineOptions_ErrorUnrecognisedArgument;
+        }
+
+        *failed = (CommandLineOptionHandle) owner->GetIndex(opt);
+        if (IsFlag(*opt)) {
+            auto result = SetFlag(opt);
+            if (result != CommandLineOptions_Ok) {
+                return result;
+            }
+            owner->MarkFound(opt, clusterIndex);
+            continue;
+        }
+
+        auto value = p + 1;
+        if (*value == '=') {
+            ++value;
+        } else if (*value == '\0') {
+            if (*argIndex + 1 >= argc) {
+                return CommandLineOptions_ErrorArgumentExpectingValue;
+            }
+            value = argv[++*argIndex];
+        }
+        auto result = SetValue(opt, value);
+        if (result != CommandLineOptions_Ok) {
+            return result;
+        }
+        owner->MarkFound(opt, clusterIndex);
+        break;
+    }
+    return CommandLineOptions_Ok;
+}
+
+template<typename CharType>
+void CommandLineOptionsT<CharType>::Impl::AddConstraint(decltype(Constraint::type_) type, uint32_t option, CommandLineOptionHandle const* handles, uint32_t count)
+{
+    Constraint constraint{ type, option, (uint32_t) constraintBits_.size(), 0 };
+    for (uint32_t i = 0; i < count; ++i) {
+        auto h = (uint32_t) handles[i];
+        if (h < options_.size()) {
+            constraint.words_ = std::max(constraint.words_, h / 64 + 1);
+        }
+    }
+    constraintBits_.resize(constraint.begin_ + constraint.words_, 0);
+    for (uint32_t i = 0; i < count; ++i) {
+        auto h = (uint32_t) handles[i];
+        if (h < options_.size()) {
+            constraintBits_[constraint.begin_ + h / 64] |= 1ull << (h % 64);
+        }
+    }
+    constraints_.emplace_back(constraint);
+}
+
+// Checks the constraints of this and the chosen subcommand against the
+// options found by every source, and reports each one violated to sink.  If
+// source!=nullptr, *source is set to the source of the first one's option.
+template<typename CharType>
+void CommandLineOptionsT<CharType>::Impl::CheckConstraints(ErrorSink* sink, CommandLineOptionsSource* source)
+{
+    bool stopped = false;
+    for (auto impl = this; impl != nullptr; impl = impl->subcommand_ ? impl->subcommand_->impl_ : nullptr) {
+        impl->violated_.clear();
+
+        for (uint32_t c = 0, n = (uint32_t) impl->constraints_.size(); c < n; ++c) {
+            auto const& constraint = impl->constraints_[c];
+            auto bits = impl->constraintBits_.data() + constraint.begin_;
+
+            // Count the options found, where several in a word count as 2.
+            uint32_t given = 0;
+            uint64_t missing = 0;
+            for (uint32_t w = 0; w < constraint.words_; ++w) {
+                auto found = impl->GetFoundBits(w);
+                auto v = bits[w] & found;
+                given += v == 0 ? 0 : (v & (v - 1)) != 0 ? 2 : 1;
+                missing |= bits[w] & ~found;
+            }
+
+            bool violated = false;
+            auto culprit = CommandLineOptionHandle::Invalid;
+            switch (constraint.type_) {
+            case Constraint::REQUIRES:
+                violated = missing != 0 && impl->GetSource(constraint.option_) != CommandLineOptions_SourceDefault;
+                culprit = (CommandLineOptionHandle) constraint.option_;
+                break;
+            case Constraint::CONFLICTS:
+                violated = given > 1;
+                break;
+            case Constraint::ONE_OF:
+                violated = given != 1;
+                break;
+            }
+            if (!violated) {
+                continue;
             }
+            impl->violated_.emplace_back(c);
 
-            else if (opt.type_ != Option::NEWLINE) {
-                if (hasPrefix) {
-                    auto n = CLOVER_strlen(opt.name_);
-                    if (CLOVER_strnicmp(arg, opt.name_, n)) {
-                        if (arg[n] == '\0') {
-                            return Error(CommandLineOptions_ErrorArgumentExpectingValue);
-                        }
-                        if (arg[n] == '=') {
-                            arg += n + 1;
-                            switch (opt.type_) {
-                            case Option::UINT32: {
-                                uint32_t* p = (uint32_t*) opt.value_;
-                                CharT* end = nullptr;
-                                *p = CLOVER_strtoul(arg, &end, 0);
-                                if (*end != '\0' || (*p == 0 && (end == arg || errno != 0))) {
-                                    return Error(CommandLineOptions_ErrorArgumentValueInvalid);
-                                }
-                            }   break;
-                            case Option::STRING:
-                                *((CharT**) opt.value_) = arg;
-                                break;
-                            }
-                            opt.found_ = true;
-                            found = true;
-                            break;
-                        }
+            // Blame the option given last.
+            if (constraint.type_ != Constraint::REQUIRES && given > 0) {
+                int last = -2;
+                for (uint32_t i = 0, end = constraint.words_ * 64; i < end; ++i) {
+                    if (((bits[i / 64] >> (i % 64)) & 1) && impl->GetSource(i) != CommandLineOptions_SourceDefault &&
+                        impl->argIndices_[i] > last) {
+                        last = impl->argIndices_[i];
+                        culprit = (CommandLineOptionHandle) i;
                     }
                 }
             }
+
+            if (stopped) {
+                continue;
+            }
+            if (source != nullptr && sink->result_ == CommandLineOptions_Ok) {
+                *source = culprit == CommandLineOptionHandle::Invalid ? CommandLineOptions_SourceDefault :
+                                                                        impl->GetSource((uint32_t) culprit);
+            }
+            auto argIndex = culprit == CommandLineOptionHandle::Invalid ? 0 : std::max(impl->argIndices_[(uint32_t) culprit], 0);
+            stopped = sink->Report(CommandLineOptions_ErrorConstraintViolated, argIndex, culprit);
         }
+    }
+}
 
-        if (!found) {
-            return Error(CommandLineOptions_ErrorUnrecognisedArgument);
+template<typename CharType>
+void CommandLineOptionsT<CharType>::Impl::PrintConstraint(FILE* fp, Constraint const& constraint) const
+{
+    auto bits = constraintBits_.data() + constraint.begin_;
+
+    // Prints the options in the constraint that were found, weren't, or both.
+    auto PrintList = [this, fp, &constraint, bits](bool found, bool missing, char const* conjunction) {
+        auto Select = [this, bits, found, missing](uint32_t w) {
+            auto f = GetFoundBits(w);
+            return bits[w] & ((found ? f : 0) | (missing ? ~f : 0));
+        };
+        uint32_t count = 0;
+        for (uint32_t w = 0; w < constraint.words_; ++w) {
+            for (auto v = Select(w); v != 0; v &= v - 1) {
+                count += 1;
+            }
         }
+        uint32_t printed = 0;
+        for (uint32_t i = 0, end = constraint.words_ * 64; i < end; ++i) {
+            if ((Select(i / 64) >> (i % 64)) & 1) {
+                Traits::PrintNarrow(fp, printed == 0 ? "--" : printed + 1 == count ? conjunction : ", --");
+                Traits::Print(fp, options_[i].name_);
+                printed += 1;
+            }
+        }
+    };
+
+    bool anyFound = false;
+    for (uint32_t w = 0; w < constraint.words_; ++w) {
+        anyFound |= (bits[w] & GetFoundBits(w)) != 0;
     }
 
-    return CommandLineOptions_Ok;
+    if (constraint.type_ == Constraint::REQUIRES) {
+        Traits::PrintNarrow(fp, "error: --");
+        Traits::Print(fp, options_[constraint.option_].name_);
+        Traits::PrintNarrow(fp, " requires ");
+        PrintList(false, true, " and --");
+        Traits::PrintNarrow(fp, ".\n");
+    } else if (anyFound) {
+        Traits::PrintNarrow(fp, "error: only one of ");
+        PrintList(true, false, " and --");
+        Traits::PrintNarrow(fp, " may be given.\n");
+    } else {
+        Traits::PrintNarrow(fp, "error: one of ");
+        PrintList(true, true, " or --");
+        Traits::PrintNarrow(fp, " is required.\n");
+    }
+}
+
+template<typename CharType>
+void CommandLineOptionsT<CharType>::Impl::Complete(FILE* fp, CharT** words, int count, int index)
+{
+    static CharT const empty[] = { '\0' };
+
+    // Hand the words after a subcommand's name to it.
+    for (int i = 0; i < index; ++i) {
+        if (*words[i] == '-' || *words[i] == '/') {
+            continue;
+        }
+        for (auto const& sub : subcommands_) {
+            if (EqualIgnoreCase(words[i], sub.name_)) {
+                CommandLineOptionsT subcommand;
+                auto subImpl = subcommand.impl_;
+                subImpl->parent_ = this;
+                subImpl->subcommandName_ = sub.name_;
+                subImpl->parseFlags_ = parseFlags_;
+                sub.factory_(&subcommand, sub.context_);
+                subImpl->Complete(fp, words + i + 1, count - i - 1, index - i - 1);
+                return;
+            }
+        }
+    }
+
+    // The option that an argument names, if it takes a value.  An argument
+    // that ends with a short option can take its value from the next word.
+    auto ValueOption = [this](CharT const* arg, bool nextWord) -> Option* {
+        bool isShort = arg[0] == '-' && arg[1] != '-';
+        if (*arg != '-' && *arg != '/') {
+            return nullptr;
+        }
+        arg += (arg[0] == '-' && arg[1] == '-') ? 2 : 1;
+        size_t n = 0;
+        while (arg[n] != '\0' && arg[n] != '=') {
+            ++n;
+        }
+        Impl* owner = nullptr;
+        auto opt = FindOptionInScope(arg, n, &owner);
+        if (nextWord) {
+            opt = opt == nullptr && isShort && n > 0 && arg[n] == '\0' ? FindShortOptionInScope(arg[n - 1], &owner) : nullptr;
+        }
+        return opt == nullptr || IsFlag(*opt) ? nullptr : opt;
+    };
+
+    auto word = index < count ? words[index] : empty;
+    auto prev = index > 0 ? words[index - 1] : nullptr;
+
+    // bash splits "--NAME=VALUE" into "--NAME", "=" and "VALUE".
+    if (prev != nullptr && word[0] == '=' && word[1] == '\0') {
+        if (auto opt = ValueOption(prev, false)) {
+            CompleteValues(fp, *opt, empty, empty);
+        }
+        return;
+    }
+    if (prev != nullptr && prev[0] == '=' && prev[1] == '\0' && index >= 2) {
+        if (auto opt = ValueOption(words[index - 2], false)) {
+            CompleteValues(fp, *opt, empty, word);
+        }
+        return;
+    }
+
+    if (*word == '-') {
+        auto value = word;
+        while (*value != '\0' && *value != '=') {
+            ++value;
+        }
+        if (*value == '=') {
+            if (auto opt = ValueOption(word, false)) {
+                std::basic_string<CharT> before(word, value + 1);
+                CompleteValues(fp, *opt, before.c_str(), value + 1);
+            }
+        } else {
+            auto name = word + ((word[1] == '-') ? 2 : 1);
+            CompleteNames(fp, name, (size_t) (value - name));
+        }
+        return;
+    }
+
+    if (prev != nullptr) {
+        if (auto opt = ValueOption(prev, true)) {
+            CompleteValues(fp, *opt, empty, word);
+            return;
+        }
+    }
+
+    for (auto const& sub : subcommands_) {
+        auto p = word;
+        auto q = sub.name_;
+        while (*p != '\0' && Traits::FoldCase(*p) == Traits::FoldCase(*q)) {
+            ++p;
+            ++q;
+        }
+        if (*p == '\0') {
+            Traits::Print(fp, sub.name_);
+            Traits::Print(fp, (CharT) '\n');
+        }
+    }
+    if (std::any_of(options_.begin(), options_.end(), [](Option const& opt) { return opt.type_ == Option::ARG; })) {
+        CompleteFiles(fp, empty, word);
+    }
+}
+
+template<typename CharType>
+void CommandLineOptionsT<CharType>::Impl::CompleteNames(FILE* fp, CharT const* prefix, size_t n)
+{
+    for (auto impl = this; impl != nullptr; impl = impl->parent_) {
+        impl->BuildSorted();
+
+        auto const& options = impl->options_;
+        auto first = std::lower_bound(impl->sorted_.begin(), impl->sorted_.end(), 0u, [&](uint32_t i, uint32_t) {
+            return ComparePrefix(options[i], prefix, n) < 0;
+        });
+        for (auto it = first; it != impl->sorted_.end() && ComparePrefix(options[*it], prefix, n) == 0; ++it) {
+            auto const& opt = options[*it];
+            if (opt.includeInUsage_) {
+                Traits::PrintNarrow(fp, "--");
+                Traits::Print(fp, opt.name_);
+                Traits::PrintNarrow(fp, IsFlag(opt) ? "\n" : "=\n");
+            }
+        }
+    }
+}
+
+// Prints the completions of an option's value from prefix, each preceded by
+// before.
+template<typename CharType>
+void CommandLineOptionsT<CharType>::Impl::CompleteValues(FILE* fp, Option const& opt, CharT const* before, CharT const* prefix)
+{
+    if (opt.choices_ == nullptr) {
+        CompleteFiles(fp, before, prefix);
+        return;
+    }
+    for (uint32_t i = 0; i < opt.choiceCount_; ++i) {
+        auto p = prefix;
+        auto q = opt.choices_[i];
+        while (*p != '\0' && Traits::FoldCase(*p) == Traits::FoldCase(*q)) {
+            ++p;
+            ++q;
+        }
+        if (*p == '\0') {
+            Traits::Print(fp, before);
+            Traits::Print(fp, opt.choices_[i]);
+            Traits::Print(fp, (CharT) '\n');
+        }
+    }
+}
+
+template<typename CharType>
+void CommandLineOptionsT<CharType>::Impl::CompleteFiles(FILE* fp, CharT const* before, CharT const* prefix)
+{
+    // Split the prefix into the directory to list and the start of a name in
+    // it.
+    auto base = prefix;
+    for (auto p = prefix; *p != '\0'; ++p) {
+        #ifdef _WIN32
+        if (*p == '\\') {
+            base = p + 1;
+        }
+        #endif
+        if (*p == '/') {
+            base = p + 1;
+        }
+    }
+    std::basic_string<CharT> dir(prefix, base);
+    if (dir.empty()) {
+        dir.push_back('.');
+    }
+
+    auto baseLength = Traits::Length(base);
+    CLOVER_ListDirectory(dir.c_str(), [&](CharT const* name, bool isDirectory) {
+        // Hidden files are only completed if asked for.
+        if (name[0] == '.' && (base[0] != '.' || name[1] == '\0' || (name[1] == '.' && name[2] == '\0'))) {
+            return;
+        }
+        if (Traits::Length(name) < baseLength || memcmp(name, base, baseLength * sizeof(CharT)) != 0) {
+            return;
+        }
+        Traits::Print(fp, before);
+        for (auto p = prefix; p != base; ++p) {
+            Traits::Print(fp, *p);
+        }
+        Traits::Print(fp, name);
+        if (isDirectory) {
+            Traits::Print(fp, (CharT) '/');
+        }
+        Traits::Print(fp, (CharT) '\n');
+    });
+}
+
+template<typename CharType>
+void CommandLineOptionsT<CharType>::SetValueChoices(CommandLineOptionHandle handle, CharT const* const* choices, uint32_t count)
+{
+    auto i = (uint32_t) handle;
+    if (i < impl_->options_.size()) {
+        impl_->options_[i].choices_ = choices;
+        impl_->options_[i].choiceCount_ = count;
+    }
+}
+
+template<typename CharType>
+void CommandLineOptionsT<CharType>::PrintCompletionScript(FILE* fp, CommandLineOptionsShell shell, CharT const* programName) const
+{
+    // The script is a sequence of literal parts, between which the program's
+    // name is printed as-is (%P) or as part of a function name (%F).
+    static char const* const kBash =
+        "_clover_complete_%F()\n"
+        "{\n"
+        "    local IFS=$'\\n'\n"
+        "    COMPREPLY=($(%P --clover-complete=$((COMP_CWORD - 1)) \"${COMP_WORDS[@]:1}\" 2>/dev/null))\n"
+        "    if [[ ${#COMPREPLY[@]} -eq 1 && ${COMPREPLY[0]} == *[=/] ]]; then\n"
+        "        compopt -o nospace\n"
+        "    fi\n"
+        "}\n"
+        "complete -F _clover_complete_%F %P\n";
+    static char const* const kZsh =
+        "#compdef %P\n"
+        "_clover_complete_%F()\n"
+        "{\n"
+        "    local c\n"
+        "    for c in ${(f)\"$(%P --clover-complete=$((CURRENT - 2)) \"${(@)words[2,-1]}\" 2>/dev/null)\"}; do\n"
+        "        if [[ $c == *[=/] ]]; then\n"
+        "            compadd -S '' -- \"$c\"\n"
+        "        else\n"
+        "            compadd -- \"$c\"\n"
+        "        fi\n"
+        "    done\n"
+        "}\n"
+        "compdef _clover_complete_%F %P\n";
+    static char const* const kFish =
+        "function __clover_complete_%F\n"
+        "    set -l tokens (commandline -opc)\n"
+        "    %P --clover-complete=(math (count $tokens) - 1) $tokens[2..-1] (commandline -ct | string collect -N -a) 2>/dev/null\n"
+        "end\n"
+        "complete -c %P -f -a '(__clover_complete_%F)'\n";
+
+    auto script = shell == CommandLineOptions_ShellZsh  ? kZsh :
+                  shell == CommandLineOptions_ShellFish ? kFish : kBash;
+    for (auto p = script; *p != '\0'; ++p) {
+        if (p[0] == '%' && p[1] == 'P') {
+            Traits::Print(fp, programName);
+            ++p;
+        } else if (p[0] == '%' && p[1] == 'F') {
+            for (auto q = programName; *q != '\0'; ++q) {
+                auto c = *q;
+                bool isIdentifier = (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9');
+                Traits::Print(fp, isIdentifier ? c : (CharT) '_');
+            }
+            ++p;
+        } else {
+            Traits::Print(fp, (CharT) *p);
+        }
+    }
+}
+
+template<typename CharType>
+bool CommandLineOptionsT<CharType>::SetShortName(CommandLineOptionHandle handle, CharT c)
+{
+    auto i = (uint32_t) handle;
+    if (i >= impl_->options_.size() || c <= ' ' || c >= 127 || c == '-' || c == '=' || c == '?' || c == 'h' || impl_->shortIndex_[(uint32_t) c] != 0) {
+        return false;
+    }
+    auto& opt = impl_->options_[i];
+    if (opt.name_ == nullptr || opt.type_ == Impl::Option::ARG) {
+        return false;
+    }
+    opt.shortName_ = c;
+    impl_->shortIndex_[(uint32_t) c] = i + 1;
+    impl_->hasShortNames_ = true;
+    return true;
+}
+
+template<typename CharType>
+uint32_t CommandLineOptionsT<CharType>::GetSuggestions(CharT const* arg, CommandLineOptionHandle* handles, uint32_t capacity, uint32_t maxDistance) const
+{
+    using Option = typename Impl::Option;
+    typename Impl::NameDistance distance;
+    if (capacity == 0 || !distance.Init(arg)) {
+        return 0;
+    }
+    typename Impl::template Closest<CommandLineOptionHandle> closest(handles, capacity, maxDistance);
+    for (uint32_t i = 0, n = (uint32_t) impl_->options_.size(); i < n && !closest.IsFull(); ++i) {
+        auto const& opt = impl_->options_[i];
+        if (opt.name_ == nullptr || opt.type_ == Option::ARG) {
+            continue;
+        }
+        auto cutoff = closest.GetCutoff();
+        auto d = distance.Measure(opt.name_, opt.nameLength_, cutoff);
+        if (d <= cutoff) {
+            closest.Add((CommandLineOptionHandle) i, d);
+        }
+    }
+    return closest.count_;
+}
+
+template<typename CharType>
+uint32_t CommandLineOptionsT<CharType>::GetSuggestions(CharT const* arg, Suggestion* suggestions, uint32_t capacity, uint32_t maxDistance) const
+{
+    using Option = typename Impl::Option;
+    typename Impl::NameDistance distance;
+    if (capacity == 0 || !distance.Init(arg)) {
+        return 0;
+    }
+
+    // The argument was looked up in the subcommand that Parse() chose, if
+    // any, and then in the instances enclosing it.
+    auto scope = impl_;
+    while (scope->subcommand_ != nullptr) {
+        scope = scope->subcommand_->impl_;
+    }
+    typename Impl::template Closest<Suggestion> closest(suggestions, capacity, maxDistance);
+    auto Consider = [&](CharT const* name, uint32_t length, bool isCommand) {
+        auto cutoff = closest.GetCutoff();
+        auto d = distance.Measure(name, length, cutoff);
+        bool seen = std::any_of(suggestions, suggestions + closest.count_, [&](Suggestion const& s) {
+            return s.isCommand_ == isCommand && Impl::EqualIgnoreCase(s.name_, name);
+        });
+        if (d <= cutoff && !seen) {
+            closest.Add(Suggestion{ name, isCommand }, d);
+        }
+    };
+    for (auto impl = scope; impl != nullptr && !closest.IsFull(); impl = impl->parent_) {
+        for (auto const& opt : impl->options_) {
+            if (opt.name_ != nullptr && opt.type_ != Option::ARG && !closest.IsFull()) {
+                Consider(opt.name_, opt.nameLength_, false);
+            }
+        }
+    }
+    if (*arg != '-' && *arg != '/') {
+        for (auto const& sub : scope->subcommands_) {
+            if (!closest.IsFull()) {
+                Consider(sub.name_, (uint32_t) Traits::Length(sub.name_), true);
+            }
+        }
+    }
+    return closest.count_;
+}
+
+template<typename CharType>
+void CommandLineOptionsT<CharType>::PrintError(FILE* fp, CommandLineOptionsResult result, CharT const* arg) const
+{
+    switch (result) {
+    case CommandLineOptions_ErrorArgumentExpectingValue: Traits::PrintNarrow(fp, "error: command line argument expecting value: "); break;
+    case CommandLineOptions_ErrorArgumentValueInvalid:   Traits::PrintNarrow(fp, "error: invalid command line argument value: "); break;
+    case CommandLineOptions_ErrorUnrecognisedArgument:   Traits::PrintNarrow(fp, "error: unrecognised command line argument: "); break;
+    case CommandLineOptions_ErrorAmbiguousArgument:      Traits::PrintNarrow(fp, "error: ambiguous command line argument: "); break;
+    case CommandLineOptions_ErrorConstraintViolated:
+        for (auto impl = impl_; impl != nullptr; impl = impl->subcommand_ ? impl->subcommand_->impl_ : nullptr) {
+            for (auto c : impl->violated_) {
+                impl->PrintConstraint(fp, impl->constraints_[c]);
+            }
+        }
+        return;
+    default: return;
+    }
+    Traits::Print(fp, arg);
+    Traits::PrintNarrow(fp, ".\n");
+
+    // List the options, or subcommands, it could have been.
+    Suggestion suggestions[3];
+    uint32_t count = 0;
+    if (result == CommandLineOptions_ErrorUnrecognisedArgument) {
+        count = GetSuggestions(arg, suggestions, 3);
+    } else if (result == CommandLineOptions_ErrorAmbiguousArgument) {
+        CommandLineOptionHandle handles[3];
+        count = std::min(GetAmbiguousOptions(handles, 3), 3u);
+        for (uint32_t i = 0; i < count; ++i) {
+            suggestions[i] = Suggestion{ impl_->options_[(uint32_t) handles[i]].name_, false };
+        }
+    }
+    for (uint32_t i = 0; i < count; ++i) {
+        Traits::PrintNarrow(fp, i == 0 ? "did you mean " : i + 1 == count ? " or " : ", ");
+        Traits::PrintNarrow(fp, suggestions[i].isCommand_ ? "" : "--");
+        Traits::Print(fp, suggestions[i].name_);
+    }
+    if (count > 0) {
+        Traits::PrintNarrow(fp, "?\n");
+    }
+}
+
+template<typename CharType>
+void CommandLineOptionsT<CharType>::SetParseFlags(uint32_t flags)
+{
+    impl_->parseFlags_ = flags;
+}
+
+template<typename CharType>
+void CommandLineOptionsT<CharType>::AddRequires(CommandLineOptionHandle option, CommandLineOptionHandle const* required, uint32_t count)
+{
+    if ((uint32_t) option < impl_->options_.size()) {
+        impl_->AddConstraint(Impl::Constraint::REQUIRES, (uint32_t) option, required, count);
+    }
+}
+
+template<typename CharType>
+void CommandLineOptionsT<CharType>::AddConflicts(CommandLineOptionHandle const* options, uint32_t count)
+{
+    impl_->AddConstraint(Impl::Constraint::CONFLICTS, 0, options, count);
+}
+
+template<typename CharType>
+void CommandLineOptionsT<CharType>::AddOneOf(CommandLineOptionHandle const* options, uint32_t count)
+{
+    impl_->AddConstraint(Impl::Constraint::ONE_OF, 0, options, count);
+}
+
+template<typename CharType>
+int CommandLineOptionsT<CharType>::GetArgIndex(CommandLineOptionHandle handle) const
+{
+    auto i = (uint32_t) handle;
+    return i < impl_->argIndices_.size() ? impl_->argIndices_[i] : -1;
+}
+
+template<typename CharType>
+uint32_t CommandLineOptionsT<CharType>::GetAmbiguousOptions(CommandLineOptionHandle* handles, uint32_t capacity) const
+{
+    auto count = (uint32_t) impl_->ambiguous_.size();
+    for (uint32_t i = 0; i < count && i < capacity; ++i) {
+        handles[i] = (CommandLineOptionHandle) impl_->ambiguous_[i];
+    }
+    return count;
 }
 
-uint32_t CommandLineOptions::GetOptionCount(bool includeNewlines) const
+template<typename CharType>
+uint32_t CommandLineOptionsT<CharType>::GetOptionCount(bool includeNewlines) const
 {
-    uint32_t count = (uint32_t) options_.size();
+    uint32_t count = (uint32_t) impl_->options_.size();
     if (!includeNewlines) {
-        for (auto const& opt : options_) {
-            if (opt.type_ == Option::NEWLINE) {
+        for (auto const& opt : impl_->options_) {
+            if (opt.type_ == Impl::Option::NEWLINE || opt.type_ == Impl::Option::SECTION) {
                 count -= 1;
             }
         }
@@ -370,17 +5606,158 @@ uint32_t CommandLineOptions::GetOptionCount(bool includeNewlines) const
     return count;
 }
 
-bool CommandLineOptions::WasFound(CharT const* name) const
+template<typename CharType>
+CommandLineOptionsResult CommandLineOptionsT<CharType>::ParseEnvironment(CharT const* prefix, CharT** envp, CharT const** errorVariable)
 {
-    for (auto const& opt : options_) {
-        if (CLOVER_stricmp(name, opt.name_)) {
-            return opt.found_;
+    using Option = typename Impl::Option;
+
+    if (envp == nullptr) {
+        envp = Traits::GetEnvironment();
+        if (envp == nullptr) {
+            return CommandLineOptions_Ok;
         }
     }
-    return false;
+
+    impl_->BeginSource(CommandLineOptions_SourceEnvironment);
+
+    auto prefixLength = prefix == nullptr ? 0 : Traits::Length(prefix);
+    for (; *envp != nullptr; ++envp) {
+        auto name = *envp;
+
+        size_t i = 0;
+        while (i < prefixLength && Impl::IndexFold(name[i]) == Impl::IndexFold(prefix[i])) {
+            ++i;
+        }
+        if (i < prefixLength) {
+            continue;
+        }
+        name += prefixLength;
+
+        auto value = name;
+        while (*value != '\0' && *value != '=') {
+            ++value;
+        }
+        if (*value == '\0') {
+            continue;
+        }
+
+        auto opt = impl_->FindOption(name, (size_t) (value - name), true);
+        if (opt == nullptr || opt->type_ == Option::ARG || impl_->IsBlocked(opt)) {
+            continue;
+        }
+
+        auto result = Impl::SetValue(opt, value + 1);
+        if (result != CommandLineOptions_Ok) {
+            if (errorVariable != nullptr) {
+                *errorVariable = *envp;
+            }
+            return result;
+        }
+        impl_->MarkSet(CommandLineOptions_SourceEnvironment, opt);
+    }
+
+    return CommandLineOptions_Ok;
+}
+
+template<typename CharType>
+CommandLineOptionsResult CommandLineOptionsT<CharType>::ParseConfigFile(char const* path, int* errorLine)
+{
+    typename Impl::Mapping mapping;
+    if (!Impl::MapFile(path, &mapping)) {
+        if (errorLine != nullptr) {
+            *errorLine = 0;
+        }
+        return CommandLineOptions_ErrorUnrecognisedArgument;
+    }
+    if (mapping.address_ == nullptr) {
+        return CommandLineOptions_Ok;
+    }
+    impl_->mappings_.emplace_back(mapping);
+
+    return impl_->ParseConfig((CharT*) mapping.address_, mapping.size_ / sizeof(CharT), errorLine);
+}
+
+template<typename CharType>
+bool CommandLineOptionsT<CharType>::WasFound(CharT const* name) const
+{
+    return WasFound(FindOption(name));
 }
 
-#undef CLOVER_MAKESTR
-#undef CLOVER_stricmp
-#undef CLOVER_strnicmp
-#undef CLOVER_strlen
+template<typename CharType>
+bool CommandLineOptionsT<CharType>::WasFound(CommandLineOptionHandle handle) const
+{
+    return GetSource(handle) != CommandLineOptions_SourceDefault;
+}
+
+template<typename CharType>
+CommandLineOptionsResult CommandLineOptionsT<CharType>::Resolve(int argc, CharT** argv, CharT const* envPrefix, char const* configPath,
+                                                                CommandLineOptionsSource* errorSource, int* errorIndex)
+{
+    auto Error = [errorSource](CommandLineOptionsSource source, CommandLineOptionsResult result) {
+        if (errorSource != nullptr) {
+            *errorSource = source;
+        }
+        return result;
+    };
+
+    // Constraints are checked once every source is applied.
+    impl_->deferConstraints_ = true;
+    auto result = Parse(argc, argv, errorIndex);
+    impl_->deferConstraints_ = false;
+    if (result != CommandLineOptions_Ok) {
+        return Error(CommandLineOptions_SourceCommandLine, result);
+    }
+
+    if (envPrefix != nullptr) {
+        CharT const* errorVariable = nullptr;
+        result = ParseEnvironment(envPrefix, nullptr, &errorVariable);
+        if (result != CommandLineOptions_Ok) {
+            if (errorIndex != nullptr) {
+                auto envp = Traits::GetEnvironment();
+                for (*errorIndex = 0; envp[*errorIndex] != errorVariable; ++*errorIndex) {
+                }
+            }
+            return Error(CommandLineOptions_SourceEnvironment, result);
+        }
+    }
+
+    if (configPath != nullptr) {
+        result = ParseConfigFile(configPath, errorIndex);
+        if (result != CommandLineOptions_Ok) {
+            return Error(CommandLineOptions_SourceConfigFile, result);
+        }
+    }
+
+    typename Impl::ErrorSink sink{ errorIndex, nullptr, 0, 0, CommandLineOptions_Ok };
+    auto source = CommandLineOptions_SourceDefault;
+    impl_->CheckConstraints(&sink, &source);
+    if (sink.result_ != CommandLineOptions_Ok) {
+        return Error(source, sink.result_);
+    }
+
+    return CommandLineOptions_Ok;
+}
+
+template<typename CharType>
+CommandLineOptionHandle CommandLineOptionsT<CharType>::FindOption(CharT const* name) const
+{
+    auto opt = impl_->FindOption(name, Traits::Length(name), false);
+    return opt == nullptr ? CommandLineOptionHandle::Invalid : (CommandLineOptionHandle) impl_->GetIndex(opt);
+}
+
+template<typename CharType>
+CommandLineOptionsSource CommandLineOptionsT<CharType>::GetSource(CommandLineOptionHandle handle) const
+{
+    auto i = (uint32_t) handle;
+    return i < impl_->options_.size() ? impl_->GetSource(i) : CommandLineOptions_SourceDefault;
+}
+
+template class CommandLineOptionsT<char>;
+template class CommandLineOptionsT<wchar_t>;
+
+#if CLOVER_ENABLE_RUNTIME
+template class CommandLineSharedOptionsT<char>;
+template class CommandLineSharedOptionsT<wchar_t>;
+#endif
+
+#endif // CLOVER_IMPLEMENTATION